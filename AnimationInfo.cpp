@@ -23,12 +23,14 @@
 
 #include "AnimationInfo.h"
 #include "BaseReader.h"
+#include "SpriteIndex.h"
 
 #include "graphics_common.h"
 
 #if defined(USE_X86_GFX)
 #include "graphics_mmx.h"
 #include "graphics_sse2.h"
+#include "graphics_avx2.h"
 #endif
 
 #if defined(USE_PPC_GFX)
@@ -43,6 +45,9 @@
 //Mion: for special graphics routine handling
 static unsigned int cpufuncs;
 
+// guards the lock count of surfaces drawn from several threads
+static SDL_mutex *surface_lock_mutex = NULL;
+
 
 AnimationInfo::AnimationInfo()
 {
@@ -51,6 +56,9 @@ AnimationInfo::AnimationInfo()
     image_name = NULL;
     image_surface = NULL;
     alpha_buf = NULL;
+    opaque_rect = NULL;
+    sprite_index = NULL;
+    sprite_no = -1;
 
     duration_list = NULL;
     color_list = NULL;
@@ -122,6 +130,8 @@ void AnimationInfo::deleteSurface(){
     image_surface = NULL;
     if (alpha_buf) delete[] alpha_buf;
     alpha_buf = NULL;
+    deleteOpaqueRect();
+    if (sprite_index) sprite_index->remove( sprite_no );
 }
 
 void AnimationInfo::remove(){
@@ -250,8 +260,8 @@ void AnimationInfo::blendOnSurface( SDL_Surface *dst_surface, int dst_x, int dst
 
     /* ---------------------------------------- */
     
-    SDL_LockSurface( dst_surface );
-    SDL_LockSurface( image_surface );
+    lockSurface( dst_surface );
+    lockSurface( image_surface );
     
 #ifdef BPP16
     int total_width = image_surface->pitch / 2;
@@ -379,10 +389,87 @@ void AnimationInfo::blendOnSurface( SDL_Surface *dst_surface, int dst_x, int dst
     }
 #endif
 break2:
-    SDL_UnlockSurface( image_surface );
-    SDL_UnlockSurface( dst_surface );
+    unlockSurface( image_surface );
+    unlockSurface( dst_surface );
 }
 
+// Steps n = a*x/1000 (truncated toward zero, as the division in C)
+// along x one pixel at a time without dividing: n is kept as a
+// floored quotient q and a remainder 0 <= r < 1000.
+struct AffineStepper{
+    int q, r, dq, dr;
+    AffineStepper( int a, int x ){
+        floorDiv( a*x, &q, &r );
+        floorDiv( a, &dq, &dr );
+    };
+    static void floorDiv( int n, int *q, int *r ){
+        *q = n / 1000;
+        *r = n % 1000;
+        if (*r < 0){ (*q)--; *r += 1000; }
+    };
+    int value(){ return (r != 0 && q < 0) ? q+1 : q; };
+    void step(){
+        q += dq;
+        r += dr;
+        if (r >= 1000){ q++; r -= 1000; }
+    };
+};
+
+// Narrow [*xs, *xe] to the x where 0 <= a*x/1000 + offset < size.
+// The projection is monotonic in x, so the range stays contiguous
+// and its ends can be found by bisection.
+static void clipAffineSpan( int a, int offset, int size, int *xs, int *xe )
+{
+    if (*xs > *xe) return;
+    if (a == 0){
+        if (offset < 0 || offset >= size) *xe = *xs - 1;
+        return;
+    }
+
+    // first x whose projection has come into the image
+    int lo = *xs, hi = *xe + 1;
+    while (lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        int v = a * mid / 1000 + offset;
+        if ((a > 0) ? (v >= 0) : (v < size)) hi = mid;
+        else                                lo = mid + 1;
+    }
+    int new_xs = lo;
+
+    // first x whose projection has left the image again
+    hi = *xe + 1;
+    while (lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        int v = a * mid / 1000 + offset;
+        if ((a > 0) ? (v >= size) : (v < 0)) hi = mid;
+        else                                 lo = mid + 1;
+    }
+
+    *xs = new_xs;
+    *xe = lo - 1;
+}
+
+// a*x/1000 as above in 16.16 fixed point, and its step to the next x.
+// Stepping adds up to half a unit of rounding per pixel, so the start
+// is put 32 units (1/2048) above the exact value: for the next
+// AFFINE_FIXED_RUN pixels the integer part stays that of the exact
+// value, whose fraction is a multiple of 1/1000.  The division in C
+// truncates toward zero, so the value is rounded up while a*x is
+// negative, which is decided by the sides of x = 0 and a; a run must
+// not cross x = 0.
+#define AFFINE_FIXED_RUN 32
+static void affineFixed( int a, int x, int *f, int *df )
+{
+    int q, r;
+    bool negative = (x < 0) ? (a > 0) : (a < 0);
+    AffineStepper::floorDiv( negative ? a*x + 999 : a*x, &q, &r );
+    *f = q*65536 + (r*65536 + 500) / 1000 + 32;
+    AffineStepper::floorDiv( a, &q, &r );
+    *df = q*65536 + (r*65536 + 500) / 1000;
+}
+
+#define AFFINE_GATHER_SIZE 256
+
 //Mion - ogapee2008
 void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int dst_y,
                                      SDL_Rect &clip, int alpha )
@@ -407,8 +494,8 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
     if (min_xy[1] >= clip.y+clip.h) return;
     if (min_xy[1] < clip.y) min_xy[1] = clip.y;
 
-    SDL_LockSurface( dst_surface );
-    SDL_LockSurface( image_surface );
+    lockSurface( dst_surface );
+    lockSurface( image_surface );
     
 #ifdef BPP16
     int total_width = image_surface->pitch / 2;
@@ -431,49 +518,85 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
             }
         }
 
-        ONSBuf *dst_buffer = (ONSBuf *)dst_surface->pixels + dst_surface->w * y + raster_min;
-
-        // inverse-projection
+        // inverse-projection; the source span is found before the
+        // raster scan so that the inner loops need neither divisions
+        // nor bounds checks
         int x_offset = inv_mat[0][1] * (y-dst_y) / 1000 + pos.w/2;
         int y_offset = inv_mat[1][1] * (y-dst_y) / 1000 + pos.h/2;
-        for (x=raster_min-dst_x ; x<=raster_max-dst_x ; x++, dst_buffer++){
-            int x2 = inv_mat[0][0] * x / 1000 + x_offset;
-            int y2 = inv_mat[1][0] * x / 1000 + y_offset;
+        int xs = raster_min-dst_x, xe = raster_max-dst_x;
+        clipAffineSpan( inv_mat[0][0], x_offset, pos.w, &xs, &xe );
+        clipAffineSpan( inv_mat[1][0], y_offset, pos.h, &xs, &xe );
+        if (xs > xe) continue;
 
-            if (x2 < 0 || x2 >= pos.w ||
-                y2 < 0 || y2 >= pos.h) continue;
+        ONSBuf *dst_buffer = (ONSBuf *)dst_surface->pixels + dst_surface->w * y + xs + dst_x;
+        ONSBuf *src_cell = (ONSBuf *)image_surface->pixels + pos.w*current_cell;
+
+#ifndef BPP16
+        // gather the source pixels in 16.16 fixed point, then blend
+        // them a run at a time
+        Uint32 src_row[AFFINE_GATHER_SIZE];
+        for (x=xs ; x<=xe ; ){
+            int n = 0;
+            while (x<=xe && n+AFFINE_FIXED_RUN <= AFFINE_GATHER_SIZE){
+                int len = xe - x + 1;
+                if (len > AFFINE_FIXED_RUN) len = AFFINE_FIXED_RUN;
+                if (x < 0 && x + len > 0) len = -x;
+                int fx, fy, dfx, dfy;
+                affineFixed( inv_mat[0][0], x, &fx, &dfx );
+                affineFixed( inv_mat[1][0], x, &fy, &dfy );
+                imageFilterAffineGather( src_row + n, src_cell, total_width,
+                                         fx + x_offset*65536, fy + y_offset*65536,
+                                         dfx, dfy, len );
+                x += len;
+                n += len;
+            }
 
-            ONSBuf *src_buffer = (ONSBuf *)image_surface->pixels + total_width * y2 + x2 + pos.w*current_cell;
-#ifdef BPP16
-            unsigned char *alphap = alpha_buf + image_surface->w * y2 + x2 + pos.w*current_cell;
-#else
 #if SDL_BYTEORDER == SDL_LIL_ENDIAN
-            unsigned char *alphap = (unsigned char *)src_buffer + 3;
+            Uint8 *alphap = (Uint8 *)src_row + 3;
 #else
-            unsigned char *alphap = (unsigned char *)src_buffer;
-#endif
-#endif
-#ifndef BPP16
-            if (blending_mode == BLEND_NORMAL) {
+            Uint8 *alphap = (Uint8 *)src_row;
 #endif
-                if ((trans_mode == TRANS_COPY) && (alpha == 256)) {
-                    SET_PIXEL(*src_buffer, 0xff);
-                } else {
-                    BLEND_PIXEL();
+            if (blending_mode == BLEND_NORMAL){
+                if ((trans_mode == TRANS_COPY) && (alpha == 256))
+                    memcpy( dst_buffer, src_row, n*4 );
+                else
+                    imageFilterBlend( dst_buffer, src_row, alphap, alpha, n );
+                dst_buffer += n;
+            }
+            else{
+                Uint32 *src_buffer = src_row;
+                for (i=n ; i ; i--, src_buffer++, dst_buffer++){
+                    if (blending_mode == BLEND_ADD){
+                        ADDBLEND_PIXEL();
+                    }
+                    else if (blending_mode == BLEND_SUB){
+                        SUBBLEND_PIXEL();
+                    }
                 }
-#ifndef BPP16
-            } else if (blending_mode == BLEND_ADD) {
-                ADDBLEND_PIXEL();
-            } else if (blending_mode == BLEND_SUB) {
-                SUBBLEND_PIXEL();
             }
-#endif
         }
+#else
+        AffineStepper sx( inv_mat[0][0], xs ), sy( inv_mat[1][0], xs );
+        for (x=xs ; x<=xe ; x++, dst_buffer++){
+            int x2 = sx.value() + x_offset;
+            int y2 = sy.value() + y_offset;
+            sx.step();
+            sy.step();
+
+            ONSBuf *src_buffer = src_cell + total_width * y2 + x2;
+            unsigned char *alphap = alpha_buf + image_surface->w * y2 + x2 + pos.w*current_cell;
+            if ((trans_mode == TRANS_COPY) && (alpha == 256)) {
+                SET_PIXEL(*src_buffer, 0xff);
+            } else {
+                BLEND_PIXEL();
+            }
+        }
+#endif
     }
     
     // unlock surface
-    SDL_UnlockSurface( image_surface );
-    SDL_UnlockSurface( dst_surface );
+    unlockSurface( image_surface );
+    unlockSurface( dst_surface );
 }
 
 // used to draw characters on text_surface
@@ -483,6 +606,7 @@ void AnimationInfo::blendBySurface( SDL_Surface *surface, int dst_x, int dst_y,
                                     SDL_Rect *clip, bool rotate_flag )
 {
     if (image_surface == NULL || surface == NULL) return;
+    deleteOpaqueRect();
     
     SDL_Rect dst_rect = {dst_x, dst_y, surface->w, surface->h};
     if (rotate_flag){
@@ -655,7 +779,9 @@ void AnimationInfo::allocImage( int w, int h )
 #ifdef BPP16
         alpha_buf = new unsigned char[w*h];
 #endif        
+        if (sprite_index) sprite_index->add( sprite_no );
     }
+    deleteOpaqueRect();
 
     abs_flag = true;
     pos.w = w / num_of_cells;
@@ -665,6 +791,7 @@ void AnimationInfo::allocImage( int w, int h )
 void AnimationInfo::copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_Rect *dst_rect )
 {
     if (!image_surface || !surface) return;
+    deleteOpaqueRect();
     
     SDL_Rect _dst_rect = {0, 0};
     if (dst_rect) _dst_rect = *dst_rect;
@@ -705,6 +832,7 @@ void AnimationInfo::copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_R
 void AnimationInfo::fill( Uint8 r, Uint8 g, Uint8 b, Uint8 a )
 {
     if (!image_surface) return;
+    deleteOpaqueRect();
     
     SDL_LockSurface( image_surface );
     ONSBuf *dst_buffer = (ONSBuf *)image_surface->pixels;
@@ -850,6 +978,82 @@ void AnimationInfo::setupImage( SDL_Surface *surface, SDL_Surface *surface_m, bo
     }
     
     SDL_UnlockSurface( surface );
+
+    calcOpaqueRect();
+}
+
+// Find the longest run of rows of each cell that are opaque across
+// the whole cell width.  Drawing the cell over that part leaves
+// nothing of what is below, so the compositor may skip it.
+void AnimationInfo::calcOpaqueRect()
+{
+    deleteOpaqueRect();
+    if (image_surface == NULL || num_of_cells <= 0) return;
+
+    int w2 = image_surface->w / num_of_cells;
+    opaque_rect = new SDL_Rect[num_of_cells];
+
+    SDL_LockSurface( image_surface );
+    for (int c=0 ; c<num_of_cells ; c++){
+        int top = 0, run = 0, best_top = 0, best_run = 0;
+        for (int i=0 ; i<image_surface->h ; i++){
+#ifdef BPP16
+            unsigned char *alphap = alpha_buf + image_surface->w * i + w2 * c;
+            int step = 1;
+#else
+            unsigned char *alphap = (unsigned char *)image_surface->pixels + image_surface->pitch * i + w2 * c * 4;
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+            alphap += 3;
+#endif
+            int step = 4;
+#endif
+            int j;
+            for (j=0 ; j<w2 && *alphap == 0xff ; j++) alphap += step;
+            if (j < w2){
+                run = 0;
+                continue;
+            }
+            if (run++ == 0) top = i;
+            if (run > best_run){
+                best_top = top;
+                best_run = run;
+            }
+        }
+        opaque_rect[c].x = 0;
+        opaque_rect[c].y = best_top;
+        opaque_rect[c].w = (best_run > 0) ? w2 : 0;
+        opaque_rect[c].h = best_run;
+    }
+    SDL_UnlockSurface( image_surface );
+}
+
+void AnimationInfo::deleteOpaqueRect()
+{
+    if (opaque_rect) delete[] opaque_rect;
+    opaque_rect = NULL;
+}
+
+// Whether blendOnSurface() at (dst_x, dst_y) overwrites every pixel
+// inside clip regardless of what has been drawn there before.
+bool AnimationInfo::isOpaqueOver( int dst_x, int dst_y, SDL_Rect &clip )
+{
+    if (image_surface == NULL || opaque_rect == NULL) return false;
+    if (affine_flag || blending_mode != BLEND_NORMAL || trans != 256) return false;
+#ifdef BPP16
+    // BLEND_PIXEL keeps a little of the destination even at full alpha
+    if (trans_mode != TRANS_COPY) return false;
+#else
+    if (trans_mode == TRANS_LAYER) return false;
+#endif
+    if (current_cell < 0 || current_cell >= num_of_cells) return false;
+
+    SDL_Rect &rect = opaque_rect[current_cell];
+    if (rect.w == 0 || rect.h == 0) return false;
+
+    return (dst_x + rect.x <= clip.x &&
+            dst_y + rect.y <= clip.y &&
+            dst_x + rect.x + rect.w >= clip.x + clip.w &&
+            dst_y + rect.y + rect.h >= clip.y + clip.h);
 }
 
 
@@ -863,6 +1067,33 @@ unsigned int AnimationInfo::getCpufuncs()
     return cpufuncs;
 }
 
+// Surfaces are locked around every drawing routine; SDL keeps a plain
+// counter for that, so the locks have to be serialized once sprites
+// are drawn from several threads at the same time (BandRenderer).
+void AnimationInfo::setMultiThreaded( bool flag )
+{
+    if ( flag && surface_lock_mutex == NULL )
+        surface_lock_mutex = SDL_CreateMutex();
+    else if ( !flag && surface_lock_mutex ){
+        SDL_DestroyMutex( surface_lock_mutex );
+        surface_lock_mutex = NULL;
+    }
+}
+
+void AnimationInfo::lockSurface( SDL_Surface *surface )
+{
+    if ( surface_lock_mutex ) SDL_LockMutex( surface_lock_mutex );
+    SDL_LockSurface( surface );
+    if ( surface_lock_mutex ) SDL_UnlockMutex( surface_lock_mutex );
+}
+
+void AnimationInfo::unlockSurface( SDL_Surface *surface )
+{
+    if ( surface_lock_mutex ) SDL_LockMutex( surface_lock_mutex );
+    SDL_UnlockSurface( surface );
+    if ( surface_lock_mutex ) SDL_UnlockMutex( surface_lock_mutex );
+}
+
 
 void AnimationInfo::imageFilterMean(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length)
 {
@@ -989,3 +1220,78 @@ void AnimationInfo::imageFilterBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uin
 #endif
 }
 
+void AnimationInfo::imageFilterCrossfade(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer, int alpha, int length)
+{
+#if defined(USE_X86_GFX)
+#ifndef MACOSX
+    if (cpufuncs & CPUF_X86_AVX2) {
+
+        imageFilterCrossfade_AVX2(dst_buffer, src1_buffer, src2_buffer, alpha, length);
+
+    } else if (cpufuncs & CPUF_X86_SSE2) {
+#endif // !MACOSX
+
+        imageFilterCrossfade_SSE2(dst_buffer, src1_buffer, src2_buffer, alpha, length);
+
+#ifndef MACOSX
+    } else {
+        int n = length + 1;
+        Uint32 mask2 = alpha;
+        BASIC_CROSSFADE();
+    }
+#endif // !MACOSX
+
+#else // no special gfx handling
+    int n = length + 1;
+    Uint32 mask2 = alpha;
+    BASIC_CROSSFADE();
+#endif
+}
+
+void AnimationInfo::imageFilterCrossfadeMask(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer,
+                                             Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length)
+{
+#if defined(USE_X86_GFX)
+#ifndef MACOSX
+    if (cpufuncs & CPUF_X86_AVX2) {
+
+        imageFilterCrossfadeMask_AVX2(dst_buffer, src1_buffer, src2_buffer,
+                                      maskp, mask_value, threshold_flag, length);
+
+    } else if (cpufuncs & CPUF_X86_SSE2) {
+#endif // !MACOSX
+
+        imageFilterCrossfadeMask_SSE2(dst_buffer, src1_buffer, src2_buffer,
+                                      maskp, mask_value, threshold_flag, length);
+
+#ifndef MACOSX
+    } else {
+        int n = length + 1;
+        BASIC_CROSSFADE_MASK();
+    }
+#endif // !MACOSX
+
+#else // no special gfx handling
+    int n = length + 1;
+    BASIC_CROSSFADE_MASK();
+#endif
+}
+
+void AnimationInfo::imageFilterAffineGather(Uint32 *dst_buffer, Uint32 *src_buffer, int pitch,
+                                            int fx, int fy, int dfx, int dfy, int length)
+{
+#if defined(USE_X86_GFX) && !defined(MACOSX)
+    if (cpufuncs & CPUF_X86_AVX2) {
+
+        imageFilterAffineGather_AVX2(dst_buffer, src_buffer, pitch, fx, fy, dfx, dfy, length);
+
+    } else {
+        int n = length + 1;
+        BASIC_AFFINE_GATHER();
+    }
+
+#else // no special gfx handling
+    int n = length + 1;
+    BASIC_AFFINE_GATHER();
+#endif
+}
@@ -35,6 +35,8 @@
 
 typedef unsigned char uchar3[3];
 
+class SpriteIndex;
+
 class AnimationInfo{
 public:
 #ifdef BPP16
@@ -86,6 +88,7 @@ public:
         CPUF_X86_SSE        =  2,
         CPUF_X86_SSE2       =  4,
         CPUF_PPC_ALTIVEC    =  8,
+        CPUF_X86_AVX2       = 16,
     };
 
     char *file_name;
@@ -99,6 +102,9 @@ public:
     char *image_name;
     SDL_Surface *image_surface;
     unsigned char *alpha_buf;
+    SDL_Rect *opaque_rect; // fully opaque part of each cell, set up by setupImage()
+    SpriteIndex *sprite_index; // set for the entries of sprite_info and sprite2_info
+    int sprite_no;
     /* Variables for extended sprite (lsp2, drawsp2, etc.) - Mion: ogapee2008 */
     int scale_x, scale_y, rot;
     int mat[2][2], inv_mat[2][2];
@@ -152,12 +158,23 @@ public:
     void copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_Rect *dst_rect = NULL );
     void fill( Uint8 r, Uint8 g, Uint8 b, Uint8 a );
     void setupImage( SDL_Surface *surface, SDL_Surface *surface_m, bool has_alpha );
+    void calcOpaqueRect();
+    void deleteOpaqueRect();
+    bool isOpaqueOver( int dst_x, int dst_y, SDL_Rect &clip );
     static void setCpufuncs(unsigned int func);
     static unsigned int getCpufuncs();
+    static void setMultiThreaded( bool flag );
+    static void lockSurface( SDL_Surface *surface );
+    static void unlockSurface( SDL_Surface *surface );
     static void imageFilterMean(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length);
     static void imageFilterAddTo(unsigned char *dst, unsigned char *src, int length);
     static void imageFilterSubFrom(unsigned char *dst, unsigned char *src, int length);
     static void imageFilterBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+    static void imageFilterCrossfade(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer, int alpha, int length);
+    static void imageFilterCrossfadeMask(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer,
+                                         Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length);
+    static void imageFilterAffineGather(Uint32 *dst_buffer, Uint32 *src_buffer, int pitch,
+                                        int fx, int fy, int dfx, int dfy, int length);
 };
 
 #endif // __ANIMATION_INFO_H__
@@ -0,0 +1,71 @@
+/* -*- C++ -*-
+ *
+ *  AudioGain.cpp - fixed-point gain for 16-bit samples
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AudioGain.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// one block of GAIN_BLOCK samples, 0 <= gain <= 32767
+static inline void scaleBlock( Sint16 *buf, int gain )
+{
+#ifdef __SSE2__
+    __m128i a = _mm_loadu_si128( (__m128i*)buf );
+    __m128i g = _mm_set1_epi16( (short)gain );
+    __m128i lo = _mm_mullo_epi16( a, g );
+    __m128i hi = _mm_mulhi_epi16( a, g );
+    __m128i round = _mm_set1_epi32( 1 << 14 );
+    __m128i p0 = _mm_srai_epi32( _mm_add_epi32( _mm_unpacklo_epi16( lo, hi ), round ), 15 );
+    __m128i p1 = _mm_srai_epi32( _mm_add_epi32( _mm_unpackhi_epi16( lo, hi ), round ), 15 );
+    _mm_storeu_si128( (__m128i*)buf, _mm_packs_epi32( p0, p1 ) );
+#else
+    for ( int i=0 ; i<GAIN_BLOCK ; i++ )
+        buf[i] = (Sint16)( (buf[i] * gain + (1 << 14)) >> 15 );
+#endif
+}
+
+void applyGain( Sint16 *buf, int num, int gain_start, int gain_end )
+{
+    if ( gain_start == GAIN_UNITY && gain_end == GAIN_UNITY ) return;
+
+    // the gain steps once per block, reaching gain_end with the last
+    int num_blocks = (num + GAIN_BLOCK - 1) / GAIN_BLOCK;
+    if ( num_blocks == 0 ) return;
+    Sint32 gain = gain_start * 256; // Q23 while ramping
+    Sint32 step = (gain_end - gain_start) * 256 / num_blocks;
+
+    for ( int i=0 ; i<num ; i+=GAIN_BLOCK ){
+        int g = gain_end;
+        if ( gain_start != gain_end ){
+            gain += step;
+            if ( i + GAIN_BLOCK < num ) g = gain >> 8;
+        }
+        // 1.0 does not fit in 16 bits
+        if ( g > GAIN_UNITY - 1 ) g = GAIN_UNITY - 1;
+        if ( g < 0 ) g = 0;
+
+        if ( i + GAIN_BLOCK <= num ){
+            scaleBlock( buf + i, g );
+        }
+        else{
+            for ( int j=i ; j<num ; j++ )
+                buf[j] = (Sint16)( (buf[j] * g + (1 << 14)) >> 15 );
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/* -*- C++ -*-
+ *
+ *  AudioGain.h - fixed-point gain for 16-bit samples
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __AUDIO_GAIN_H__
+#define __AUDIO_GAIN_H__
+
+#include <SDL.h>
+
+#define GAIN_UNITY 32768 // gains are in Q15
+#define GAIN_BLOCK 8     // samples sharing one step of a ramp
+
+// volume in percent, as given to the volume commands
+inline int volumeToGain( int volume ){ return volume * GAIN_UNITY / 100; }
+
+// Scales num native 16-bit samples.  The gain goes linearly from
+// gain_start to gain_end over the buffer, so that a volume change
+// between two buffers does not click; pass the gain the previous
+// buffer ended with as gain_start.  The buffer is left as it is at
+// unity gain.
+void applyGain( Sint16 *buf, int num, int gain_start, int gain_end );
+
+#endif // __AUDIO_GAIN_H__
@@ -0,0 +1,156 @@
+/* -*- C++ -*-
+ *
+ *  BandRenderer.cpp - Parallel drawing of a rectangle in horizontal bands
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "BandRenderer.h"
+#include <stdio.h>
+
+static int bandThread( void *userdata )
+{
+    return ((BandRenderer*)userdata)->workLoop();
+}
+
+BandRenderer::BandRenderer()
+{
+    num_threads = 0;
+    mutex = NULL;
+    start_cond = done_cond = NULL;
+    quit_flag = false;
+
+    job_no = 0;
+    func = NULL;
+    data = NULL;
+    num_bands = next_band = num_done = 0;
+}
+
+BandRenderer::~BandRenderer()
+{
+    close();
+}
+
+void BandRenderer::open( int num_threads )
+{
+    close();
+    if ( num_threads <= 0 ) return;
+    if ( num_threads > MAX_BAND_THREADS ) num_threads = MAX_BAND_THREADS;
+
+    mutex = SDL_CreateMutex();
+    start_cond = SDL_CreateCond();
+    done_cond = SDL_CreateCond();
+    quit_flag = false;
+
+    for ( int i=0 ; i<num_threads ; i++ ){
+        thread[this->num_threads] = SDL_CreateThread( bandThread, this );
+        if ( thread[this->num_threads] == NULL ){
+            fprintf( stderr, "BandRenderer: can't create a thread: %s\n", SDL_GetError() );
+            break;
+        }
+        this->num_threads++;
+    }
+}
+
+void BandRenderer::close()
+{
+    if ( mutex == NULL ) return;
+
+    SDL_LockMutex( mutex );
+    quit_flag = true;
+    SDL_CondBroadcast( start_cond );
+    SDL_UnlockMutex( mutex );
+
+    for ( int i=0 ; i<num_threads ; i++ )
+        SDL_WaitThread( thread[i], NULL );
+    num_threads = 0;
+
+    SDL_DestroyCond( done_cond );
+    SDL_DestroyCond( start_cond );
+    SDL_DestroyMutex( mutex );
+    done_cond = start_cond = NULL;
+    mutex = NULL;
+}
+
+void BandRenderer::render( SDL_Rect &clip, BandFunc func, void *data )
+{
+    int num = clip.h / MIN_BAND_HEIGHT;
+    if ( num > num_threads + 1 ) num = num_threads + 1;
+    if ( num <= 1 ){
+        func( data, clip );
+        return;
+    }
+
+    SDL_LockMutex( mutex );
+    this->func = func;
+    this->data = data;
+    this->clip = clip;
+    num_bands = num;
+    next_band = 0;
+    num_done = 0;
+    job_no++;
+    SDL_CondBroadcast( start_cond );
+    SDL_UnlockMutex( mutex );
+
+    // the calling thread takes bands as well
+    while ( renderBand() );
+
+    SDL_LockMutex( mutex );
+    while ( num_done < num_bands ) SDL_CondWait( done_cond, mutex );
+    SDL_UnlockMutex( mutex );
+}
+
+int BandRenderer::workLoop()
+{
+    int last_job_no = 0;
+
+    SDL_LockMutex( mutex );
+    while ( !quit_flag ){
+        if ( job_no == last_job_no ){
+            SDL_CondWait( start_cond, mutex );
+            continue;
+        }
+        last_job_no = job_no;
+
+        SDL_UnlockMutex( mutex );
+        while ( renderBand() );
+        SDL_LockMutex( mutex );
+    }
+    SDL_UnlockMutex( mutex );
+
+    return 0;
+}
+
+bool BandRenderer::renderBand()
+{
+    SDL_LockMutex( mutex );
+    if ( next_band >= num_bands ){
+        SDL_UnlockMutex( mutex );
+        return false;
+    }
+    int no = next_band++;
+    SDL_UnlockMutex( mutex );
+
+    SDL_Rect band = clip;
+    band.y = clip.y + clip.h * no / num_bands;
+    band.h = clip.y + clip.h * (no+1) / num_bands - band.y;
+    func( data, band );
+
+    SDL_LockMutex( mutex );
+    if ( ++num_done == num_bands ) SDL_CondSignal( done_cond );
+    SDL_UnlockMutex( mutex );
+
+    return true;
+}
@@ -0,0 +1,69 @@
+/* -*- C++ -*-
+ *
+ *  BandRenderer.h - Parallel drawing of a rectangle in horizontal bands
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __BAND_RENDERER_H__
+#define __BAND_RENDERER_H__
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#define MAX_BAND_THREADS 16
+#define MIN_BAND_HEIGHT  16
+
+// Splits a rectangle into horizontal bands and calls a drawing
+// function for each band, on a pool of worker threads and on the
+// calling thread.  render() returns when all bands are done.  The
+// drawing function must only touch the pixels inside its band, so
+// that the result does not depend on how the rectangle was split.
+class BandRenderer
+{
+public:
+    typedef void (*BandFunc)( void *data, SDL_Rect &band );
+
+    BandRenderer();
+    ~BandRenderer();
+
+    void open( int num_threads );
+    void close();
+    bool isActive(){ return num_threads > 0; };
+
+    void render( SDL_Rect &clip, BandFunc func, void *data );
+
+    int workLoop();
+
+private:
+    bool renderBand(); // false when no band is left
+
+    SDL_Thread *thread[MAX_BAND_THREADS];
+    int num_threads;
+    SDL_mutex *mutex;
+    SDL_cond *start_cond; // signalled when a new job is posted
+    SDL_cond *done_cond;  // signalled when the last band is finished
+    bool quit_flag;
+
+    int job_no;
+    BandFunc func;
+    void *data;
+    SDL_Rect clip;
+    int num_bands;
+    int next_band;
+    int num_done;
+};
+
+#endif // __BAND_RENDERER_H__
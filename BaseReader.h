@@ -68,6 +68,8 @@ struct BaseReader
         struct FileInfo *fi_list;
         unsigned int num_of_files;
         unsigned long base_offset;
+        unsigned char *map_buf; // the whole archive, if memory-mapped
+        size_t map_length;
 
         ArchiveInfo(){
             next = NULL;
@@ -75,6 +77,8 @@ struct BaseReader
             file_name = NULL;
             fi_list = NULL;
             num_of_files = 0;
+            map_buf = NULL;
+            map_length = 0;
         }
     };
 
@@ -90,6 +94,11 @@ struct BaseReader
     virtual struct FileInfo getFileByIndex( unsigned int index ) = 0;
     virtual size_t getFileLength( const char *file_name ) = 0;
     virtual size_t getFile( const char *file_name, unsigned char *buffer, int *location=NULL ) = 0;
+    // read-only view of an uncompressed file inside a memory-mapped
+    // archive, or NULL if the file has to be read with getFile()
+    virtual const unsigned char *getFileMap( const char *file_name, size_t *length, int *location=NULL ) = 0;
+    // forget what is known about the loose files, after writing one
+    virtual void resetFileListing(){};
 };
 
 #endif // __BASE_READER_H__
@@ -25,6 +25,9 @@
 #include <bzlib.h>
 #if !defined(WIN32) && !defined(MACOS9) && !defined(PSP) && !defined(__OS2__)
 #include <dirent.h>
+#include <unistd.h>
+#define USE_DIR_LISTING
+#define USE_PREAD
 #endif
 
 #ifdef WIN32
@@ -53,7 +56,6 @@ static iconv_t iconv_cd = NULL;
 #define SEEK_END 2
 #endif
 
-#define READ_LENGTH 4096
 #define WRITE_LENGTH 5000
 
 #define EI 8
@@ -70,6 +72,8 @@ DirectReader::DirectReader( DirPaths *path, const unsigned char *key_table )
     file_full_path = NULL;
     file_sub_path = NULL;
     file_path_len = 0;
+    dir_listing = NULL;
+    file_mutex = SDL_CreateMutex();
 
     capital_name = new char[MAX_FILE_NAME_LENGTH*2+1];
     capital_name_tmp = new char[MAX_FILE_NAME_LENGTH*2+1];
@@ -90,10 +94,6 @@ DirectReader::DirectReader( DirPaths *path, const unsigned char *key_table )
         for (i=0 ; i<256 ; i++) this->key_table[i] = (unsigned char) i;
     }
 
-    read_buf = new unsigned char[READ_LENGTH];
-    decomp_buffer = new unsigned char[N*2];
-    decomp_buffer_len = N*2;
-
     last_registered_compression_type = &root_registered_compression_type;
     registerCompressionType( "SPB", SPB_COMPRESSION );
     registerCompressionType( "JPG", NO_COMPRESSION );
@@ -113,8 +113,8 @@ DirectReader::~DirectReader()
         iconv_cd = NULL;
     }
 #endif
-    delete[] read_buf;
-    delete[] decomp_buffer;
+    resetFileListing();
+    SDL_DestroyMutex(file_mutex);
     
     last_registered_compression_type = root_registered_compression_type.next;
     while ( last_registered_compression_type ){
@@ -148,6 +148,29 @@ FILE *DirectReader::fopen(const char *path, const char *mode)
         if (file_sub_path) delete[] file_sub_path;
         file_sub_path = new char[file_path_len];
     }
+
+#ifdef USE_DIR_LISTING
+    // Resolve the path against the cached directory listings, so that
+    // probing for files that only exist in archives costs no syscalls.
+    // Paths with "." or ".." components are left to the code below.
+    bool listable = (path[0] != DELIMITER);
+    for (const char *p = path; listable && *p; ) {
+        if (p[0] == '.' && (p[1] == DELIMITER || p[1] == '\0' ||
+                            (p[1] == '.' && (p[2] == DELIMITER || p[2] == '\0'))))
+            listable = false;
+        while (*p && *p != DELIMITER) p++;
+        while (*p == DELIMITER) p++;
+    }
+    if (listable) {
+        // exact names first, as plain fopen would find them
+        for (int pass=0; pass<2; pass++)
+            for (int n=0; n<archive_path->get_num_paths(); n++)
+                if (resolveListedPath(archive_path->get_path(n), path, pass == 0))
+                    return ::fopen( file_full_path, mode );
+        return NULL;
+    }
+#endif
+
     for (int n=0; n<archive_path->get_num_paths(); n++) {
         sprintf( file_full_path, "%s%s", archive_path->get_path(n), path );
 	//printf("filename: \"%s\": ", file_full_path);
@@ -242,6 +265,119 @@ FILE *DirectReader::fopen(const char *path, const char *mode)
     return fp;
 }
 
+#ifdef USE_DIR_LISTING
+static int compareNameNoCase( const void *a, const void *b )
+{
+    return strcasecmp( *(const char**)a, *(const char**)b );
+}
+#endif
+
+DirectReader::DirListing *DirectReader::getDirListing( const char *dir )
+{
+    DirListing *dl = dir_listing;
+    while (dl) {
+        if (!strcmp(dl->path, dir)) return dl;
+        dl = dl->next;
+    }
+
+    dl = new DirListing();
+    dl->path = new char[strlen(dir)+1];
+    strcpy(dl->path, dir);
+    dl->next = dir_listing;
+    dir_listing = dl;
+
+#ifdef USE_DIR_LISTING
+    // a directory that can't be opened is cached as empty
+    DIR *dp = opendir( (dir[0] != '\0') ? dir : "." );
+    if (dp == NULL) return dl;
+
+    struct dirent *entp;
+    size_t len = 0;
+    int num = 0;
+    while ( (entp = readdir(dp)) != NULL ){
+        if ( !strcmp(entp->d_name, ".") || !strcmp(entp->d_name, "..") ) continue;
+        len += strlen(entp->d_name) + 1;
+        num++;
+    }
+    rewinddir(dp);
+
+    dl->names = new char*[num+1];
+    dl->name_buf = new char[len+1];
+    char *buf = dl->name_buf;
+    while ( dl->num_of_names < num && (entp = readdir(dp)) != NULL ){
+        if ( !strcmp(entp->d_name, ".") || !strcmp(entp->d_name, "..") ) continue;
+        size_t l = strlen(entp->d_name) + 1;
+        if ( buf + l > dl->name_buf + len ) break; // directory grew meanwhile
+        memcpy(buf, entp->d_name, l);
+        dl->names[dl->num_of_names++] = buf;
+        buf += l;
+    }
+    closedir( dp );
+
+    qsort( dl->names, dl->num_of_names, sizeof(char*), compareNameNoCase );
+#endif
+
+    return dl;
+}
+
+const char *DirectReader::findDirEntry( DirListing *dl, const char *name, bool exact )
+{
+#ifdef USE_DIR_LISTING
+    int lo = 0, hi = dl->num_of_names;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcasecmp(dl->names[mid], name) < 0) lo = mid + 1;
+        else                                      hi = mid;
+    }
+    for ( ; lo < dl->num_of_names && !strcasecmp(dl->names[lo], name) ; lo++)
+        if (!exact || !strcmp(dl->names[lo], name)) return dl->names[lo];
+#endif
+    return NULL;
+}
+
+// Builds the on-disk name of root+path in file_full_path, matching
+// each component either exactly or case-insensitively.
+bool DirectReader::resolveListedPath( const char *root, const char *path, bool exact )
+{
+    size_t len = strlen(root);
+    memcpy(file_full_path, root, len+1);
+
+    const char *cur_p = path;
+    while (1) {
+        while (*cur_p == DELIMITER) cur_p++;
+        const char *delim_p = strchr( cur_p, (char)DELIMITER );
+        size_t n = delim_p ? (size_t)(delim_p - cur_p) : strlen(cur_p);
+        if (n == 0) return false;
+        memcpy(file_sub_path, cur_p, n);
+        file_sub_path[n] = '\0';
+
+        file_full_path[len] = '\0';
+        const char *name = findDirEntry( getDirListing(file_full_path), file_sub_path, exact );
+        if (name == NULL) return false;
+        memcpy(file_full_path+len, name, n);
+        len += n;
+
+        if (delim_p == NULL) break;
+        file_full_path[len++] = DELIMITER;
+        cur_p = delim_p + 1;
+    }
+    file_full_path[len] = '\0';
+
+    return true;
+}
+
+// Drops the cached listings; call after writing new loose files.
+void DirectReader::resetFileListing()
+{
+    SDL_LockMutex( file_mutex );
+    while (dir_listing) {
+        DirListing *dl = dir_listing;
+        dir_listing = dir_listing->next;
+        delete dl;
+    }
+    SDL_UnlockMutex( file_mutex );
+}
+
 unsigned char DirectReader::readChar( FILE *fp )
 {
     unsigned char ret = 0;
@@ -317,6 +453,7 @@ int DirectReader::close()
 }
 
 void DirectReader::setArchivePath( DirPaths *path ) {
+    resetFileListing();
     if ( path != NULL ){
         archive_path = path;
     }
@@ -348,14 +485,19 @@ int DirectReader::getRegisteredCompressionType( const char *file_name )
     while( *ext_buf != '.' && ext_buf != file_name ) ext_buf--;
     ext_buf++;
     
-    strcpy( capital_name, ext_buf );
-    for ( unsigned int i=0 ; i<strlen(ext_buf)+1 ; i++ )
-        if ( capital_name[i] >= 'a' && capital_name[i] <= 'z' )
-            capital_name[i] += 'A' - 'a';
+    char capital_ext[MAX_FILE_NAME_LENGTH+1];
+    size_t len = strlen(ext_buf);
+    if ( len > MAX_FILE_NAME_LENGTH ) len = MAX_FILE_NAME_LENGTH;
+    for ( unsigned int i=0 ; i<len ; i++ ){
+        capital_ext[i] = ext_buf[i];
+        if ( capital_ext[i] >= 'a' && capital_ext[i] <= 'z' )
+            capital_ext[i] += 'A' - 'a';
+    }
+    capital_ext[len] = '\0';
     
     RegisteredCompressionType *reg = root_registered_compression_type.next;
     while (reg){
-        if ( !strcmp( capital_name, reg->ext ) ) return reg->type;
+        if ( !strcmp( capital_ext, reg->ext ) ) return reg->type;
 
         reg = reg->next;
     }
@@ -375,6 +517,8 @@ FILE *DirectReader::getFileHandle( const char *file_name, int &compression_type,
     FILE *fp;
     unsigned int i;
 
+    SDL_LockMutex( file_mutex );
+
     compression_type = NO_COMPRESSION;
     size_t len = strlen( file_name );
     if ( len > MAX_FILE_NAME_LENGTH ) len = MAX_FILE_NAME_LENGTH;
@@ -440,6 +584,8 @@ FILE *DirectReader::getFileHandle( const char *file_name, int &compression_type,
             fseek( fp, 0, SEEK_SET );
         }
     }
+
+    SDL_UnlockMutex( file_mutex );
             
     return fp;
 }
@@ -463,11 +609,15 @@ size_t DirectReader::getFile( const char *file_name, unsigned char *buffer,
     FILE *fp = getFileHandle( file_name, compression_type, &len );
     
     if ( fp ){
-        if ( compression_type & NBZ_COMPRESSION )
-            return decodeNBZ( fp, 0, buffer );
-        
-        if ( compression_type & SPB_COMPRESSION )
-            return decodeSPB( fp, 0, buffer );
+        if ( compression_type & (NBZ_COMPRESSION | SPB_COMPRESSION) ){
+            DecodeContext ctx( fp, 0 );
+            if ( compression_type & NBZ_COMPRESSION )
+                total = decodeNBZ( ctx, buffer );
+            else
+                total = decodeSPB( ctx, buffer );
+            fclose( fp );
+            return total;
+        }
 
         total = len;
         while( len > 0 ){
@@ -487,6 +637,12 @@ size_t DirectReader::getFile( const char *file_name, unsigned char *buffer,
     return total;
 }
 
+const unsigned char *DirectReader::getFileMap( const char *file_name, size_t *length,
+                                              int *location )
+{
+    return NULL;
+}
+
 void DirectReader::convertFromSJISToEUC( char *buf )
 {
     int i = 0;
@@ -537,35 +693,72 @@ void DirectReader::convertFromSJISToUTF8( char *dst_buf, char *src_buf, size_t s
 #endif
 }
 
-size_t DirectReader::decodeNBZ( FILE *fp, size_t offset, unsigned char *buf )
+// Reads len bytes at offset without moving the stream position.
+size_t DirectReader::readAt( FILE *fp, size_t offset, unsigned char *buf, size_t len )
 {
-    if (key_table_flag)
-        fprintf(stderr, "may not decode NBZ with key_table enabled.\n");
-    
-    unsigned int original_length, count;
-	BZFILE *bfp;
-	void *unused;
-	int err, len, nunused;
-
+#ifdef USE_PREAD
+    ssize_t ret = pread( fileno( fp ), buf, len, offset );
+    return (ret > 0) ? (size_t)ret : 0;
+#else
+    SDL_LockMutex( file_mutex );
+    fpos_t pos;
+    fgetpos( fp, &pos );
     fseek( fp, offset, SEEK_SET );
-    original_length = count = readLong( fp );
+    size_t ret = fread( buf, 1, len, fp );
+    fsetpos( fp, &pos );
+    SDL_UnlockMutex( file_mutex );
+    return ret;
+#endif
+}
 
-	bfp = BZ2_bzReadOpen( &err, fp, 0, 0, NULL, 0 );
-	if ( bfp == NULL || err != BZ_OK ) return 0;
+size_t DirectReader::readContext( DecodeContext &ctx, unsigned char *buf, size_t len )
+{
+    if ( ctx.map_buf ){
+        if ( ctx.pos >= ctx.map_length ) return 0;
+        if ( len > ctx.map_length - ctx.pos ) len = ctx.map_length - ctx.pos;
+        memcpy( buf, ctx.map_buf + ctx.pos, len );
+    }
+    else{
+        len = readAt( ctx.fp, ctx.pos, buf, len );
+    }
+    ctx.pos += len;
 
-	while( err == BZ_OK && count > 0 ){
-        if ( count >= READ_LENGTH )
-            len = BZ2_bzRead( &err, bfp, buf, READ_LENGTH );
-        else
-            len = BZ2_bzRead( &err, bfp, buf, count );
-        count -= len;
-		buf += len;
-	}
+    return len;
+}
+
+size_t DirectReader::decodeNBZ( DecodeContext &ctx, unsigned char *buf )
+{
+    if (key_table_flag)
+        fprintf(stderr, "may not decode NBZ with key_table enabled.\n");
+    
+    unsigned char len_buf[4];
+    if ( readContext( ctx, len_buf, 4 ) != 4 ) return 0;
+    unsigned int original_length = key_table[len_buf[0]];
+    original_length = original_length << 8 | key_table[len_buf[1]];
+    original_length = original_length << 8 | key_table[len_buf[2]];
+    original_length = original_length << 8 | key_table[len_buf[3]];
+
+    bz_stream strm;
+    memset( &strm, 0, sizeof(strm) );
+    if ( BZ2_bzDecompressInit( &strm, 0, 0 ) != BZ_OK ) return 0;
+
+    strm.next_out  = (char*)buf;
+    strm.avail_out = original_length;
+
+    int err = BZ_OK;
+    while( err == BZ_OK && strm.avail_out > 0 ){
+        if ( strm.avail_in == 0 ){
+            ctx.read_len = readContext( ctx, ctx.read_buf, READ_LENGTH );
+            if ( ctx.read_len == 0 ) break;
+            strm.next_in  = (char*)ctx.read_buf;
+            strm.avail_in = ctx.read_len;
+        }
+        err = BZ2_bzDecompress( &strm );
+    }
 
-	BZ2_bzReadGetUnused(&err, bfp, &unused, &nunused );
-	BZ2_bzReadClose( &err, bfp );
+    BZ2_bzDecompressEnd( &strm );
 
-    return original_length - count;
+    return original_length - strm.avail_out;
 }
 
 size_t DirectReader::encodeNBZ( FILE *fp, size_t length, unsigned char *buf )
@@ -593,42 +786,60 @@ size_t DirectReader::encodeNBZ( FILE *fp, size_t length, unsigned char *buf )
     return bytes_out;
 }
 
-int DirectReader::getbit( FILE *fp, int n )
+// Make at least n (<= 32) bits available in ctx.bit_buf.  The key
+// table is applied to each refill of read_buf as a whole, and the
+// bits are moved into the accumulator 32 at a time where possible.
+bool DirectReader::fillBits( DecodeContext &ctx, int n )
 {
-    int i, x = 0;
-    static int getbit_buf;
-    
-    for ( i=0 ; i<n ; i++ ){
-        if ( getbit_mask == 0 ){
-            if (getbit_len == getbit_count){
-                getbit_len = fread(read_buf, 1, READ_LENGTH, fp);
-                if (getbit_len == 0) return EOF;
-                getbit_count = 0;
-            }
+    while ( ctx.bit_len < n ){
+        if ( ctx.read_count == ctx.read_len ){
+            ctx.read_len = readContext( ctx, ctx.read_buf, READ_LENGTH );
+            ctx.read_count = 0;
+            if ( ctx.read_len == 0 ) return false;
+            if ( key_table_flag )
+                for ( size_t i=0 ; i<ctx.read_len ; i++ )
+                    ctx.read_buf[i] = key_table[ctx.read_buf[i]];
+        }
 
-            getbit_buf = key_table[read_buf[getbit_count++]];
-            getbit_mask = 128;
+        const unsigned char *p = ctx.read_buf + ctx.read_count;
+        if ( ctx.bit_len <= 32 && ctx.read_len - ctx.read_count >= 4 ){
+            ctx.bit_buf = ctx.bit_buf << 32 |
+                (Uint32)p[0] << 24 | (Uint32)p[1] << 16 | (Uint32)p[2] << 8 | p[3];
+            ctx.read_count += 4;
+            ctx.bit_len += 32;
+        }
+        else{
+            ctx.bit_buf = ctx.bit_buf << 8 | p[0];
+            ctx.read_count++;
+            ctx.bit_len += 8;
         }
-        x <<= 1;
-        if ( getbit_buf & getbit_mask ) x++;
-        getbit_mask >>= 1;
     }
-    return x;
+
+    return true;
+}
+
+// Read an n-bit (n <= 30) field, MSB first.  Returns EOF and drops
+// whatever is left when the data runs out.
+inline int DirectReader::getbit( DecodeContext &ctx, int n )
+{
+    if ( ctx.bit_len < n && !fillBits( ctx, n ) ){
+        ctx.bit_len = 0;
+        return EOF;
+    }
+    ctx.bit_len -= n;
+
+    return (int)(ctx.bit_buf >> ctx.bit_len) & ((1 << n) - 1);
 }
 
-size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
+size_t DirectReader::decodeSPB( DecodeContext &ctx, unsigned char *buf )
 {
     unsigned int count;
     unsigned char *pbuf, *psbuf;
     size_t i, j, k;
-    int c, n, m;
+    int c, n, m, v;
 
-    getbit_mask = 0;
-    getbit_len = getbit_count = 0;
-    
-    fseek( fp, offset, SEEK_SET );
-    size_t width  = readShort( fp );
-    size_t height = readShort( fp );
+    size_t width  = getbit( ctx, 16 );
+    size_t height = getbit( ctx, 16 );
 
     size_t width_pad  = (4 - width * 3 % 4) % 4;
 
@@ -654,17 +865,18 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
 
     buf += 54;
 
-    if (decomp_buffer_len < width*height+4){
-        if (decomp_buffer) delete[] decomp_buffer;
-        decomp_buffer_len = width*height+4;
-        decomp_buffer = new unsigned char[decomp_buffer_len];
-    }
+    // An m-bit code k means +(k>>1)+1 when odd and -(k>>1) when even.
+    int delta[128];
+    for ( k=0 ; k<128 ; k++ )
+        delta[k] = (k & 1) ? (int)(k>>1) + 1 : -(int)(k>>1);
+
+    unsigned char *decomp_buffer = new unsigned char[width*height+4];
     
     for ( i=0 ; i<3 ; i++ ){
         count = 0;
-        decomp_buffer[count++] = c = getbit( fp, 8 );
+        decomp_buffer[count++] = c = getbit( ctx, 8 );
         while ( count < (unsigned)(width * height) ){
-            n = getbit( fp, 3 );
+            n = getbit( ctx, 3 );
             if ( n == 0 ){
                 decomp_buffer[count++] = c;
                 decomp_buffer[count++] = c;
@@ -673,24 +885,37 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
                 continue;
             }
             else if ( n == 7 ){
-                m = getbit( fp, 1 ) + 1;
+                m = getbit( ctx, 1 ) + 1;
+            }
+            else if ( n == EOF ){
+                break;
             }
             else{
                 m = n + 2;
             }
 
-            for ( j=0 ; j<4 ; j++ ){
-                if ( m == 8 ){
-                    c = getbit( fp, 8 );
-                }
-                else{
-                    k = getbit( fp, m );
-                    if ( k & 1 ) c += (k>>1) + 1;
-                    else         c -= (k>>1);
-                }
-                decomp_buffer[count++] = c;
+            if ( m == 8 ){
+                // four raw bytes
+                if ( (v = getbit( ctx, 16 )) == EOF ) break;
+                decomp_buffer[count++] = v >> 8;
+                decomp_buffer[count++] = v;
+                if ( (v = getbit( ctx, 16 )) == EOF ) break;
+                decomp_buffer[count++] = v >> 8;
+                decomp_buffer[count++] = c = v & 0xff;
+            }
+            else{
+                // the four m-bit codes of the group in one read
+                if ( (v = getbit( ctx, m*4 )) == EOF ) break;
+                int mask = (1 << m) - 1;
+                c += delta[(v >> m*3) & mask]; decomp_buffer[count++] = c;
+                c += delta[(v >> m*2) & mask]; decomp_buffer[count++] = c;
+                c += delta[(v >> m  ) & mask]; decomp_buffer[count++] = c;
+                c += delta[ v         & mask]; decomp_buffer[count++] = c;
             }
         }
+        // truncated data: leave the rest of the plane black
+        if ( count < (unsigned)(width * height) )
+            memset( decomp_buffer + count, 0, width * height - count );
 
         pbuf  = buf + (width * 3 + width_pad)*(height-1) + i;
         psbuf = decomp_buffer;
@@ -706,30 +931,36 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
             }
         }
     }
+
+    delete[] decomp_buffer;
     
     return total_size;
 }
 
-size_t DirectReader::decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *buf )
+size_t DirectReader::decodeLZSS( DecodeContext &ctx, size_t original_length, unsigned char *buf )
 {
     unsigned int count = 0;
     int i, j, k, r, c;
+    unsigned char decomp_buffer[N];
 
-    getbit_mask = 0;
-    getbit_len = getbit_count = 0;
-
-    fseek( ai->file_handle, ai->fi_list[no].offset, SEEK_SET );
     memset( decomp_buffer, 0, N-F );
     r = N - F;
 
-    while ( count < ai->fi_list[no].original_length ){
-        if ( getbit( ai->file_handle, 1 ) ) {
-            if ((c = getbit( ai->file_handle, 8 )) == EOF) break;
+    while ( count < original_length ){
+        // a literal is 1+8 bits and a reference 1+EI+EJ bits, so
+        // look at the flag and the byte that follows it together
+        if ( ctx.bit_len < 1+8 && !fillBits( ctx, 1+8 ) ) break;
+        if ( (ctx.bit_buf >> (ctx.bit_len-1)) & 1 ){
+            ctx.bit_len -= 1+8;
+            c = (int)(ctx.bit_buf >> ctx.bit_len) & 0xff;
             buf[ count++ ] = c;
             decomp_buffer[r++] = c;  r &= (N - 1);
         } else {
-            if ((i = getbit( ai->file_handle, EI )) == EOF) break;
-            if ((j = getbit( ai->file_handle, EJ )) == EOF) break;
+            if ( ctx.bit_len < 1+EI+EJ && !fillBits( ctx, 1+EI+EJ ) ) break;
+            ctx.bit_len -= 1+EI+EJ;
+            j = (int)(ctx.bit_buf >> ctx.bit_len) & ((1 << (EI+EJ)) - 1);
+            i = j >> EJ;
+            j &= (1 << EJ) - 1;
             for (k = 0; k <= j + 1  ; k++) {
                 c = decomp_buffer[(i + k) & (N - 1)];
                 buf[ count++ ] = c;
@@ -743,22 +974,24 @@ size_t DirectReader::decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *
 
 size_t DirectReader::getDecompressedFileLength( int type, FILE *fp, size_t offset )
 {
-    fpos_t pos;
+    unsigned char buf[4];
     size_t length=0;
-    fgetpos( fp, &pos );
-    fseek( fp, offset, SEEK_SET );
+
+    if ( readAt( fp, offset, buf, 4 ) != 4 ) return 0;
     
     if ( type == NBZ_COMPRESSION ){
-        length = readLong( fp );
+        length = key_table[buf[0]];
+        length = length << 8 | key_table[buf[1]];
+        length = length << 8 | key_table[buf[2]];
+        length = length << 8 | key_table[buf[3]];
     }
     else if ( type == SPB_COMPRESSION ){
-        size_t width  = readShort( fp );
-        size_t height = readShort( fp );
+        size_t width  = key_table[buf[0]] << 8 | key_table[buf[1]];
+        size_t height = key_table[buf[2]] << 8 | key_table[buf[3]];
         size_t width_pad  = (4 - width * 3 % 4) % 4;
             
         length = (width * 3 +width_pad) * height + 54;
     }
-    fsetpos( fp, &pos );
 
     return length;
 }
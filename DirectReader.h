@@ -27,8 +27,10 @@
 #include "BaseReader.h"
 #include "DirPaths.h"
 #include <string.h>
+#include <SDL_thread.h>
 
 #define MAX_FILE_NAME_LENGTH 256
+#define READ_LENGTH 4096
 
 class DirectReader : public BaseReader
 {
@@ -40,6 +42,7 @@ public:
     int close();
 
     void setArchivePath( DirPaths *path );
+    void resetFileListing();
     const char *getArchiveName() const;
     int getNumFiles();
     void registerCompressionType( const char *ext, int type );
@@ -47,6 +50,7 @@ public:
     struct FileInfo getFileByIndex( unsigned int index );
     size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buffer, int *location=NULL );
+    const unsigned char *getFileMap( const char *file_name, size_t *length, int *location=NULL );
 
     static void convertFromSJISToEUC( char *buf );
     static void convertFromSJISToUTF8( char *dst_buf, char *src_buf, size_t src_len );
@@ -61,11 +65,31 @@ protected:
     DirPaths *archive_path;
     unsigned char key_table[256];
     bool key_table_flag;
-    int  getbit_mask;
-    size_t getbit_len, getbit_count;
-    unsigned char *read_buf;
-    unsigned char *decomp_buffer;
-    size_t decomp_buffer_len;
+    SDL_mutex *file_mutex; // guards loose-file lookups, dir_listing and the buffers above
+
+    // Read position and bit buffer for decoding one file.  Each
+    // getFile() call has its own, and archive data is read with
+    // positional reads (or from the mapping), so several threads
+    // can decode from the same archive at once.
+    struct DecodeContext{
+        FILE *fp;
+        const unsigned char *map_buf;
+        size_t map_length;
+        size_t pos;
+        unsigned char read_buf[READ_LENGTH];
+        size_t read_len, read_count;
+        Uint64 bit_buf; // unread bits are the low bit_len bits
+        int bit_len;
+        DecodeContext( FILE *fp, size_t offset, const unsigned char *map_buf=NULL, size_t map_length=0 ){
+            this->fp = fp;
+            this->map_buf = map_buf;
+            this->map_length = map_length;
+            pos = offset;
+            read_len = read_count = 0;
+            bit_buf = 0;
+            bit_len = 0;
+        };
+    };
     
     struct RegisteredCompressionType{
         RegisteredCompressionType *next;
@@ -90,6 +114,31 @@ protected:
         };
     } root_registered_compression_type, *last_registered_compression_type;
 
+    // cached contents of the directories probed for loose files
+    struct DirListing{
+        DirListing *next;
+        char *path;
+        char **names; // sorted case-insensitively
+        int num_of_names;
+        char *name_buf;
+        DirListing(){
+            next = NULL;
+            path = NULL;
+            names = NULL;
+            num_of_names = 0;
+            name_buf = NULL;
+        };
+        ~DirListing(){
+            if (path) delete[] path;
+            if (names) delete[] names;
+            if (name_buf) delete[] name_buf;
+        };
+    } *dir_listing;
+
+    DirListing *getDirListing( const char *dir );
+    const char *findDirEntry( DirListing *dl, const char *name, bool exact );
+    bool resolveListedPath( const char *root, const char *path, bool exact );
+
     FILE *fopen(const char *path, const char *mode);
     unsigned char readChar( FILE *fp );
     unsigned short readShort( FILE *fp );
@@ -97,11 +146,14 @@ protected:
     void writeChar( FILE *fp, unsigned char ch );
     void writeShort( FILE *fp, unsigned short ch );
     void writeLong( FILE *fp, unsigned long ch );
-    size_t decodeNBZ( FILE *fp, size_t offset, unsigned char *buf );
+    size_t readAt( FILE *fp, size_t offset, unsigned char *buf, size_t len );
+    size_t readContext( DecodeContext &ctx, unsigned char *buf, size_t len );
+    size_t decodeNBZ( DecodeContext &ctx, unsigned char *buf );
     size_t encodeNBZ( FILE *fp, size_t length, unsigned char *buf );
-    int getbit( FILE *fp, int n );
-    size_t decodeSPB( FILE *fp, size_t offset, unsigned char *buf );
-    size_t decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *buf );
+    bool fillBits( DecodeContext &ctx, int n );
+    int getbit( DecodeContext &ctx, int n );
+    size_t decodeSPB( DecodeContext &ctx, unsigned char *buf );
+    size_t decodeLZSS( DecodeContext &ctx, size_t original_length, unsigned char *buf );
     int getRegisteredCompressionType( const char *file_name );
     size_t getDecompressedFileLength( int type, FILE *fp, size_t offset );
     
@@ -22,46 +22,66 @@
  */
 
 #include "DirtyRect.h"
+#include <string.h>
 
 DirtyRect::DirtyRect()
 {
     area = 0;
-    total_history = 10;
-    num_history = 0;
     bounding_box.w = bounding_box.h = 0;
-    history = new SDL_Rect[total_history];
+    num_rects = 0;
+
+    tile_w = tile_h = 0;
+    tiles = NULL;
+    num_tiles = 0;
 };
 
 DirtyRect::DirtyRect( const DirtyRect &d )
 {
-    area = d.area;
-    total_history = d.total_history;
-    num_history = d.num_history;
-    bounding_box = d.bounding_box;
-    history = new SDL_Rect[total_history];
-
-    for ( int i=0 ; i<num_history ; i++ )
-        history[i] = d.history[i];
+    tile_w = tile_h = 0;
+    tiles = NULL;
+    *this = d;
 };
 
 DirtyRect& DirtyRect::operator =( const DirtyRect &d )
 {
+    if ( this == &d ) return *this;
+
+    if ( tile_w != d.tile_w || tile_h != d.tile_h || tiles == NULL ){
+        if ( tiles ) delete[] tiles;
+        tiles = NULL;
+        tile_w = d.tile_w;
+        tile_h = d.tile_h;
+        if ( d.tiles ) tiles = new unsigned char[tile_w * tile_h];
+    }
+    if ( tiles ) memcpy( tiles, d.tiles, tile_w * tile_h );
+    num_tiles = d.num_tiles;
+
     area = d.area;
-    total_history = d.total_history;
-    num_history = d.num_history;
     bounding_box = d.bounding_box;
-    delete[] history;
-    history = new SDL_Rect[total_history];
-
-    for ( int i=0 ; i<num_history ; i++ )
-        history[i] = d.history[i];
+    num_rects = d.num_rects;
+    for ( int i=0 ; i<num_rects ; i++ )
+        rects[i] = d.rects[i];
 
     return *this;
 };
 
 DirtyRect::~DirtyRect()
 {
-    delete[] history;
+    if ( tiles ) delete[] tiles;
+}
+
+void DirtyRect::setSize( int w, int h )
+{
+    if ( tiles ) delete[] tiles;
+
+    tile_w = (w + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+    tile_h = (h + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+    tiles = new unsigned char[tile_w * tile_h];
+    memset( tiles, 0, tile_w * tile_h );
+    num_tiles = 0;
+
+    area = 0;
+    if ( bounding_box.w > 0 && bounding_box.h > 0 ) markTiles( bounding_box );
 }
 
 void DirtyRect::add( SDL_Rect src )
@@ -81,36 +101,105 @@ void DirtyRect::add( SDL_Rect src )
     }
 
     bounding_box = calcBoundingBox( bounding_box, src );
+    markTiles( src );
+};
 
-    int i, min_is=0, min_hist=-1;
-    for (i=0 ; i<num_history ; i++){
-        SDL_Rect rect = calcBoundingBox(src, history[i]);
-        if (i==0 || rect.w*rect.h < min_is){
-            min_is = rect.w*rect.h;
-            min_hist = i;
+void DirtyRect::markTiles( SDL_Rect &src )
+{
+    if ( tiles == NULL ){
+        area = bounding_box.w * bounding_box.h;
+        return;
+    }
+
+    int x1 = src.x >> DIRTY_TILE_SHIFT;
+    int y1 = src.y >> DIRTY_TILE_SHIFT;
+    int x2 = (src.x + src.w - 1) >> DIRTY_TILE_SHIFT;
+    int y2 = (src.y + src.h - 1) >> DIRTY_TILE_SHIFT;
+    if ( x2 >= tile_w ) x2 = tile_w - 1;
+    if ( y2 >= tile_h ) y2 = tile_h - 1;
+
+    for ( int i=y1 ; i<=y2 ; i++ ){
+        unsigned char *p = tiles + tile_w * i;
+        for ( int j=x1 ; j<=x2 ; j++ ){
+            if ( p[j] ) continue;
+            p[j] = 1;
+            num_tiles++;
         }
     }
-    if (min_hist >= 0 &&
-        history[min_hist].w * history[min_hist].h + src.w * src.h > min_is ){
-        area -= history[min_hist].w * history[min_hist].h;
-        history[min_hist] = calcBoundingBox(src, history[min_hist]);
-        area += history[min_hist].w * history[min_hist].h;
-        return;
+    area = num_tiles << (DIRTY_TILE_SHIFT * 2);
+}
+
+// Each run of marked tiles on a tile row makes a rect, or extends
+// the rect of the row above if that has the very same run.  When
+// this gives too many rects, or the tiles cover most of the bounding
+// box anyway, the bounding box alone is returned.
+int DirtyRect::calcRects()
+{
+    num_rects = 0;
+    if ( area == 0 || bounding_box.w == 0 || bounding_box.h == 0 ) return 0;
+
+    int x1 = bounding_box.x >> DIRTY_TILE_SHIFT;
+    int y1 = bounding_box.y >> DIRTY_TILE_SHIFT;
+    int x2 = (bounding_box.x + bounding_box.w - 1) >> DIRTY_TILE_SHIFT;
+    int y2 = (bounding_box.y + bounding_box.h - 1) >> DIRTY_TILE_SHIFT;
+    if ( x2 >= tile_w ) x2 = tile_w - 1;
+    if ( y2 >= tile_h ) y2 = tile_h - 1;
+
+    if ( tiles == NULL || x2 < x1 || y2 < y1 ||
+         num_tiles * 4 >= (x2 - x1 + 1) * (y2 - y1 + 1) * 3 ){
+        rects[num_rects++] = bounding_box;
+        return num_rects;
     }
-    
-    history[ num_history++ ] = src;
-    area += src.w * src.h;
-    
-    if ( num_history == total_history ){
-        total_history += 10;
-        SDL_Rect *tmp = history;
-        history = new SDL_Rect[ total_history ];
-        for ( i=0 ; i<num_history ; i++ )
-            history[i] = tmp[i];
-
-        delete[] tmp;
+
+    int last_row[DIRTY_MAX_RECTS];
+    int i, j, k;
+    for ( i=y1 ; i<=y2 ; i++ ){
+        unsigned char *p = tiles + tile_w * i;
+        for ( j=x1 ; j<=x2 ; j++ ){
+            if ( !p[j] ) continue;
+            int start = j;
+            while ( j<x2 && p[j+1] ) j++;
+
+            int x = start << DIRTY_TILE_SHIFT;
+            int w = (j - start + 1) << DIRTY_TILE_SHIFT;
+            for ( k=0 ; k<num_rects ; k++ )
+                if ( last_row[k] == i-1 && rects[k].x == x && rects[k].w == w ) break;
+            if ( k == num_rects ){
+                if ( num_rects == DIRTY_MAX_RECTS ){
+                    num_rects = 0;
+                    rects[num_rects++] = bounding_box;
+                    return num_rects;
+                }
+                rects[k].x = x;
+                rects[k].y = i << DIRTY_TILE_SHIFT;
+                rects[k].w = w;
+                rects[k].h = 0;
+                num_rects++;
+            }
+            rects[k].h += DIRTY_TILE_SIZE;
+            last_row[k] = i;
+        }
     }
-};
+
+    // tiles stick out of the bounding box and the screen
+    for ( i=0 ; i<num_rects ; i++ ){
+        SDL_Rect &r = rects[i];
+        if ( r.x < bounding_box.x ){
+            r.w -= bounding_box.x - r.x;
+            r.x = bounding_box.x;
+        }
+        if ( r.y < bounding_box.y ){
+            r.h -= bounding_box.y - r.y;
+            r.y = bounding_box.y;
+        }
+        if ( r.x + r.w > bounding_box.x + bounding_box.w )
+            r.w = bounding_box.x + bounding_box.w - r.x;
+        if ( r.y + r.h > bounding_box.y + bounding_box.h )
+            r.h = bounding_box.y + bounding_box.h - r.y;
+    }
+
+    return num_rects;
+}
 
 SDL_Rect DirtyRect::calcBoundingBox( SDL_Rect src1, SDL_Rect &src2 )
 {
@@ -143,14 +232,16 @@ SDL_Rect DirtyRect::calcBoundingBox( SDL_Rect src1, SDL_Rect &src2 )
 void DirtyRect::clear()
 {
     area = 0;
-    num_history = 0;
+    num_rects = 0;
     bounding_box.w = bounding_box.h = 0;
+    if ( tiles && num_tiles > 0 ) memset( tiles, 0, tile_w * tile_h );
+    num_tiles = 0;
 }
 
 void DirtyRect::fill( int w, int h )
 {
-    area = w*h;
     bounding_box.x = bounding_box.y = 0;
     bounding_box.w = w;
     bounding_box.h = h;
+    markTiles( bounding_box );
 }
@@ -26,6 +26,14 @@
 
 #include <SDL.h>
 
+#define DIRTY_TILE_SHIFT 5 // 32x32 pixel tiles
+#define DIRTY_TILE_SIZE  (1 << DIRTY_TILE_SHIFT)
+#define DIRTY_MAX_RECTS  16
+
+// The invalid region is kept as a bitmap of fixed size tiles over
+// the screen; calcRects() coalesces the marked tiles into rects,
+// clipped to the bounding box.  Until setSize() is called only the
+// bounding box is tracked.
 struct DirtyRect
 {
     DirtyRect();
@@ -33,17 +41,25 @@ struct DirtyRect
     DirtyRect& operator =( const DirtyRect &d );
     ~DirtyRect();
     
+    void setSize( int w, int h );
     void add( SDL_Rect src );
     void clear();
     void fill( int w, int h );
+    int calcRects();
 
     SDL_Rect calcBoundingBox( SDL_Rect src1, SDL_Rect &src2 );
 
-    int area;
-    int total_history;
-    int num_history;
+    int area; // of the marked tiles
     SDL_Rect bounding_box;
-    SDL_Rect *history;
+    int num_rects;
+    SDL_Rect rects[DIRTY_MAX_RECTS]; // set by calcRects()
+
+private:
+    void markTiles( SDL_Rect &src );
+
+    int tile_w, tile_h;
+    unsigned char *tiles;
+    int num_tiles;
 };
 
 #endif // __DIRTY_RECT__
@@ -0,0 +1,89 @@
+/* -*- C++ -*-
+ *
+ *  GlyphCache.cpp - LRU cache of rendered glyphs and their metrics
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "GlyphCache.h"
+#include "HashIndex.h"
+
+GlyphCache::GlyphCache()
+    : LRUCache( "glyph", "glyphs", GLYPH_CACHE_HASH_SIZE,
+                DEFAULT_GLYPH_CACHE_SIZE*1024, true )
+{
+}
+
+GlyphCache::Glyph *GlyphCache::find( TTF_Font *font, Uint16 text )
+{
+    int style = TTF_GetFontStyle( font );
+    unsigned int hash = hashKey( font, style, text );
+
+    Entry *entry = (Entry*)bucket( hash );
+    for ( ; entry ; entry = (Entry*)entry->hash_next )
+        if ( entry->text == text && entry->font == font && entry->style == style )
+            break;
+
+    if ( entry ){
+        hit( entry );
+        return &entry->glyph;
+    }
+    num_misses++;
+
+    entry = new Entry();
+    entry->hash = hash;
+    entry->font = font;
+    entry->style = style;
+    entry->text = text;
+
+    Glyph &glyph = entry->glyph;
+    glyph.minx = glyph.maxx = glyph.miny = glyph.maxy = glyph.advance = 0;
+    TTF_GlyphMetrics( font, text, &glyph.minx, &glyph.maxx,
+                      &glyph.miny, &glyph.maxy, &glyph.advance );
+    glyph.ascent = TTF_FontAscent( font );
+    static SDL_Color fcol={0xff, 0xff, 0xff}, bcol={0, 0, 0};
+    glyph.surface = TTF_RenderGlyph_Shaded( font, text, fcol, bcol );
+
+    entry->size = sizeof(Entry);
+    if ( glyph.surface ) entry->size += glyph.surface->pitch * glyph.surface->h;
+
+    insert( entry );
+
+    return &glyph;
+}
+
+// Render the given characters ahead of time, until a glyph has to
+// be evicted to make room; the hit and miss counts are left alone.
+void GlyphCache::preload( TTF_Font *font, const Uint16 *text, int num )
+{
+    unsigned long saved_hits = num_hits, saved_misses = num_misses;
+    unsigned long saved_evictions = num_evictions;
+
+    for ( int i=0 ; i<num && num_evictions == saved_evictions ; i++ )
+        find( font, text[i] );
+
+    num_hits = saved_hits;
+    num_misses = saved_misses;
+}
+
+unsigned int GlyphCache::hashKey( TTF_Font *font, int style, Uint16 text )
+{
+    unsigned int h = hashMix( HASH_SEED, (unsigned int)((size_t)font >> 4) );
+    h = hashMix( h, style );
+    h = hashMix( h, text & 0xff );
+    h = hashMix( h, text >> 8 );
+
+    return h;
+}
@@ -0,0 +1,66 @@
+/* -*- C++ -*-
+ *
+ *  GlyphCache.h - LRU cache of rendered glyphs and their metrics
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __GLYPH_CACHE_H__
+#define __GLYPH_CACHE_H__
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "LRUCache.h"
+
+#define DEFAULT_GLYPH_CACHE_SIZE 2048 // in KB
+#define GLYPH_CACHE_HASH_SIZE 1024
+
+// Keeps the 8-bit coverage rendered by TTF_RenderGlyph_Shaded()
+// together with the glyph metrics and the font ascent, keyed by the
+// font (Fontinfo opens one per size), its style and the character.
+// Least recently used glyphs are dropped once the total size exceeds
+// the budget; the glyph returned last is always kept.
+class GlyphCache : public LRUCache
+{
+public:
+    struct Glyph{
+        SDL_Surface *surface;
+        int minx, maxx, miny, maxy, advance;
+        int ascent;
+    };
+
+    GlyphCache();
+
+    Glyph *find( TTF_Font *font, Uint16 text );
+    void preload( TTF_Font *font, const Uint16 *text, int num );
+
+private:
+    struct Entry : LRUCache::Entry{
+        TTF_Font *font;
+        int style;
+        Uint16 text;
+        Glyph glyph;
+        Entry(){
+            glyph.surface = NULL;
+        };
+        ~Entry(){
+            if (glyph.surface) SDL_FreeSurface(glyph.surface);
+        };
+    };
+
+    unsigned int hashKey( TTF_Font *font, int style, Uint16 text );
+};
+
+#endif // __GLYPH_CACHE_H__
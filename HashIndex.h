@@ -0,0 +1,70 @@
+/* -*- C++ -*-
+ *
+ *  HashIndex.h - String hash and open-addressed name indexes
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __HASH_INDEX_H__
+#define __HASH_INDEX_H__
+
+#include <string.h>
+
+// FNV-1a
+#define HASH_SEED 2166136261u
+
+static inline unsigned int hashMix( unsigned int h, unsigned int value )
+{
+    return (h ^ value) * 16777619u;
+}
+
+static inline unsigned int hashString( const char *str, unsigned int h = HASH_SEED )
+{
+    if ( str == NULL ) return h;
+    while ( *str ) h = hashMix( h, (unsigned char)*str++ );
+    return h;
+}
+
+// An index is a table of size slots, a power of two, each holding
+// the position of an entry + 1, or 0 if empty; collisions go to the
+// next slot.  entries[i].*name is the name of entry i.
+//
+// Entries have to be added in the order a linear search would meet
+// them: when a name is added twice, the first entry keeps the slot,
+// so that a lookup finds the same entry as that search would.
+template <class T, class E, class N>
+static void addHashIndex( T *index, unsigned int size,
+                          E *entries, N E::*name, int i )
+{
+    unsigned int j = hashString( entries[i].*name ) & (size-1);
+    while ( index[j] && strcmp( entries[index[j]-1].*name, entries[i].*name ) )
+        j = (j+1) & (size-1);
+    if ( index[j] == 0 ) index[j] = i+1;
+}
+
+// Returns the position of the entry named str, or -1.
+template <class T, class E, class N>
+static int findHashIndex( T *index, unsigned int size,
+                          E *entries, N E::*name, const char *str )
+{
+    unsigned int j = hashString( str ) & (size-1);
+    while ( index[j] ){
+        if ( !strcmp( entries[index[j]-1].*name, str ) ) return index[j]-1;
+        j = (j+1) & (size-1);
+    }
+    return -1;
+}
+
+#endif // __HASH_INDEX_H__
@@ -0,0 +1,166 @@
+/* -*- C++ -*-
+ *
+ *  ImageCache.cpp - LRU cache of images set up for sprites
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ImageCache.h"
+#include "HashIndex.h"
+#include <string.h>
+
+// the mask file name is only meaningful for ":m" tags
+static const char *maskFileName( AnimationInfo *anim )
+{
+    if ( anim->trans_mode != AnimationInfo::TRANS_MASK ) return NULL;
+    return anim->mask_file_name;
+}
+
+static bool equalString( const char *str1, const char *str2 )
+{
+    if ( str1 == NULL || str2 == NULL ) return str1 == str2;
+    return !strcmp( str1, str2 );
+}
+
+static bool sameFile( const char *name1, const char *name2 )
+{
+    for ( ; *name1 && *name2 ; name1++, name2++ ){
+        char c1 = *name1, c2 = *name2;
+        if ( c1 >= 'a' && c1 <= 'z' ) c1 += 'A' - 'a';
+        if ( c2 >= 'a' && c2 <= 'z' ) c2 += 'A' - 'a';
+        if ( c1 == '/' ) c1 = '\\';
+        if ( c2 == '/' ) c2 = '\\';
+        if ( c1 != c2 ) return false;
+    }
+    return *name1 == *name2;
+}
+
+ImageCache::ImageCache()
+    : LRUCache( "image", "images", IMAGE_CACHE_HASH_SIZE, 0, false )
+{
+}
+
+// Copy the cached image into anim, as if setupImage() had been
+// called.  Returns false if the image is not in the cache.
+bool ImageCache::restore( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type )
+{
+    if ( budget == 0 || anim->file_name == NULL ) return false;
+
+    Entry *entry = findEntry( anim, ratio1, ratio2, png_mask_type );
+    if ( entry == NULL ){
+        num_misses++;
+        return false;
+    }
+    hit( entry );
+
+    anim->allocImage( entry->surface->w, entry->surface->h );
+    SDL_LockSurface( anim->image_surface );
+    memcpy( anim->image_surface->pixels, entry->surface->pixels,
+            entry->surface->pitch * entry->surface->h );
+    SDL_UnlockSurface( anim->image_surface );
+#ifdef BPP16
+    memcpy( anim->alpha_buf, entry->alpha_buf, entry->surface->w * entry->surface->h );
+#endif
+    anim->calcOpaqueRect();
+
+    return true;
+}
+
+void ImageCache::store( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type )
+{
+    if ( budget == 0 || anim->file_name == NULL || anim->image_surface == NULL ) return;
+
+    SDL_Surface *src = anim->image_surface;
+    size_t size = src->pitch * src->h;
+#ifdef BPP16
+    size += src->w * src->h;
+#endif
+    if ( size > budget ) return;
+
+    Entry *entry = findEntry( anim, ratio1, ratio2, png_mask_type );
+    if ( entry ) removeEntry( entry );
+
+    entry = new Entry();
+    entry->hash = hashKey( anim, ratio1, ratio2, png_mask_type );
+    entry->file_name = new char[ strlen(anim->file_name) + 1 ];
+    strcpy( entry->file_name, anim->file_name );
+    if ( maskFileName( anim ) ){
+        entry->mask_file_name = new char[ strlen(anim->mask_file_name) + 1 ];
+        strcpy( entry->mask_file_name, anim->mask_file_name );
+    }
+    entry->trans_mode = anim->trans_mode;
+    memcpy( entry->direct_color, anim->direct_color, 3 );
+    entry->num_of_cells = anim->num_of_cells;
+    entry->ratio1 = ratio1;
+    entry->ratio2 = ratio2;
+    entry->png_mask_type = png_mask_type;
+
+    entry->surface = AnimationInfo::allocSurface( src->w, src->h );
+    SDL_LockSurface( src );
+    memcpy( entry->surface->pixels, src->pixels, src->pitch * src->h );
+    SDL_UnlockSurface( src );
+#ifdef BPP16
+    entry->alpha_buf = new unsigned char[ src->w * src->h ];
+    memcpy( entry->alpha_buf, anim->alpha_buf, src->w * src->h );
+#endif
+    entry->size = size;
+
+    insert( entry );
+}
+
+// drop every image that uses file_name, comparing the way the
+// archive readers do (case and path delimiters are ignored)
+void ImageCache::remove( const char *file_name )
+{
+    Entry *entry = (Entry*)lru_head;
+    while ( entry ){
+        Entry *next = (Entry*)entry->next;
+        if ( sameFile( entry->file_name, file_name ) ||
+             ( entry->mask_file_name && sameFile( entry->mask_file_name, file_name ) ) )
+            removeEntry( entry );
+        entry = next;
+    }
+}
+
+unsigned int ImageCache::hashKey( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type )
+{
+    unsigned int h = hashString( anim->file_name );
+    h = hashString( maskFileName( anim ), h ^ 0xff );
+    h = hashMix( h, anim->trans_mode );
+    h = hashMix( h, anim->num_of_cells );
+
+    return h;
+}
+
+ImageCache::Entry *ImageCache::findEntry( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type )
+{
+    unsigned int hash = hashKey( anim, ratio1, ratio2, png_mask_type );
+
+    Entry *entry = (Entry*)bucket( hash );
+    for ( ; entry ; entry = (Entry*)entry->hash_next ){
+        if ( entry->hash == hash &&
+             entry->trans_mode == anim->trans_mode &&
+             entry->num_of_cells == anim->num_of_cells &&
+             entry->ratio1 == ratio1 && entry->ratio2 == ratio2 &&
+             entry->png_mask_type == png_mask_type &&
+             ( anim->trans_mode != AnimationInfo::TRANS_DIRECT ||
+               !memcmp( entry->direct_color, anim->direct_color, 3 ) ) &&
+             equalString( entry->file_name, anim->file_name ) &&
+             equalString( entry->mask_file_name, maskFileName( anim ) ) )
+            break;
+    }
+
+    return entry;
+}
@@ -0,0 +1,73 @@
+/* -*- C++ -*-
+ *
+ *  ImageCache.h - LRU cache of images set up for sprites
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include "LRUCache.h"
+#include "AnimationInfo.h"
+
+#define DEFAULT_IMAGE_CACHE_SIZE 32 // in MB
+#define IMAGE_CACHE_HASH_SIZE 256
+
+// Keeps copies of AnimationInfo::image_surface as left by
+// setupImage(), so that showing the same image again with the same
+// tag only costs a copy.  The key is everything setupImage() and
+// loadImage() depend on: the file and mask names, the trans mode
+// (with its color and number of cells), the screen ratio and the
+// PNG mask type.  Least recently used images are dropped once the
+// total size exceeds the budget.
+class ImageCache : public LRUCache
+{
+public:
+    ImageCache();
+
+    bool restore( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type );
+    void store( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type );
+    void remove( const char *file_name );
+
+private:
+    struct Entry : LRUCache::Entry{
+        char *file_name;
+        char *mask_file_name;
+        int trans_mode;
+        uchar3 direct_color;
+        int num_of_cells;
+        int ratio1, ratio2;
+        int png_mask_type;
+        SDL_Surface *surface;
+        unsigned char *alpha_buf;
+        Entry(){
+            file_name = mask_file_name = NULL;
+            surface = NULL;
+            alpha_buf = NULL;
+        };
+        ~Entry(){
+            if (file_name) delete[] file_name;
+            if (mask_file_name) delete[] mask_file_name;
+            if (surface) SDL_FreeSurface(surface);
+            if (alpha_buf) delete[] alpha_buf;
+        };
+    };
+
+    unsigned int hashKey( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type );
+    Entry *findEntry( AnimationInfo *anim, int ratio1, int ratio2, int png_mask_type );
+};
+
+#endif // __IMAGE_CACHE_H__
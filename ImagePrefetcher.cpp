@@ -0,0 +1,318 @@
+/* -*- C++ -*-
+ *
+ *  ImagePrefetcher.cpp - Background decoding of images ahead of the script
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ImagePrefetcher.h"
+#include <SDL_image.h>
+#include <string.h>
+
+#if (SDL_IMAGE_MAJOR_VERSION*100 + SDL_IMAGE_MINOR_VERSION)*100 + SDL_IMAGE_PATCHLEVEL < 10208
+// defined by SDL_image before 1.2.8, though not in its header
+extern "C" int IMG_InitJPG();
+extern "C" int IMG_InitPNG();
+#endif
+
+SDL_mutex *ImagePrefetcher::loader_mutex = NULL;
+
+static int decodeThread( void *userdata )
+{
+    return ((ImagePrefetcher*)userdata)->decodeLoop();
+}
+
+ImagePrefetcher::ImagePrefetcher()
+{
+    entry_list = NULL;
+    format = NULL;
+    num_threads = 0;
+    mutex = NULL;
+    cond = NULL;
+    quit_flag = false;
+
+    num_entries = 0;
+    total_size = 0;
+    scan_no = 0;
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    close();
+}
+
+void ImagePrefetcher::initLoaders()
+{
+    if ( loader_mutex ) return;
+
+#if (SDL_IMAGE_MAJOR_VERSION*100 + SDL_IMAGE_MINOR_VERSION)*100 + SDL_IMAGE_PATCHLEVEL < 10208
+    IMG_InitJPG();
+    IMG_InitPNG();
+#else
+    IMG_Init( IMG_INIT_JPG | IMG_INIT_PNG );
+#endif
+    loader_mutex = SDL_CreateMutex();
+}
+
+bool ImagePrefetcher::lockLoader( SDL_RWops *src )
+{
+    if ( loader_mutex == NULL ) return false;
+    if ( !IMG_isGIF( src ) && !IMG_isXPM( src ) ) return false;
+
+    SDL_LockMutex( loader_mutex );
+    return true;
+}
+
+void ImagePrefetcher::unlockLoader( bool locked )
+{
+    if ( locked ) SDL_UnlockMutex( loader_mutex );
+}
+
+void ImagePrefetcher::open( SDL_PixelFormat *format, int num_threads )
+{
+    close();
+    if ( num_threads <= 0 ) return;
+    if ( num_threads > MAX_PREFETCH_THREADS ) num_threads = MAX_PREFETCH_THREADS;
+
+    this->format = format;
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+    quit_flag = false;
+
+    for ( int i=0 ; i<num_threads ; i++ ){
+        thread[this->num_threads] = SDL_CreateThread( decodeThread, this );
+        if ( thread[this->num_threads] == NULL ){
+            fprintf( stderr, "ImagePrefetcher: can't create a thread: %s\n", SDL_GetError() );
+            break;
+        }
+        this->num_threads++;
+    }
+}
+
+void ImagePrefetcher::close()
+{
+    if ( mutex == NULL ) return;
+
+    SDL_LockMutex( mutex );
+    quit_flag = true;
+    SDL_CondBroadcast( cond );
+    SDL_UnlockMutex( mutex );
+
+    for ( int i=0 ; i<num_threads ; i++ )
+        SDL_WaitThread( thread[i], NULL );
+    num_threads = 0;
+
+    while ( entry_list ) removeEntry( entry_list );
+
+    SDL_DestroyCond( cond );
+    SDL_DestroyMutex( mutex );
+    cond = NULL;
+    mutex = NULL;
+}
+
+void ImagePrefetcher::beginScan()
+{
+    scan_no++;
+}
+
+bool ImagePrefetcher::request( const char *file_name, BaseReader *reader )
+{
+    if ( num_threads == 0 ) return false;
+
+    SDL_LockMutex( mutex );
+    if ( findEntry( file_name ) ){
+        SDL_UnlockMutex( mutex );
+        return true;
+    }
+    if ( num_entries >= PREFETCH_MAX_ENTRIES && !evictEntry( true ) ){
+        SDL_UnlockMutex( mutex );
+        return false;
+    }
+
+    Entry *entry = new Entry();
+    entry->file_name = new char[ strlen(file_name) + 1 ];
+    strcpy( entry->file_name, file_name );
+    entry->reader = reader;
+    entry->state = QUEUED;
+    entry->scan_no = scan_no;
+
+    // keep the list in the order of the requests
+    Entry **p = &entry_list;
+    while ( *p ) p = &(*p)->next;
+    *p = entry;
+    num_entries++;
+
+    SDL_CondSignal( cond );
+    SDL_UnlockMutex( mutex );
+
+    return true;
+}
+
+SDL_Surface *ImagePrefetcher::take( const char *file_name, bool *has_alpha, int *location )
+{
+    if ( num_threads == 0 ) return NULL;
+
+    SDL_LockMutex( mutex );
+    Entry *entry = findEntry( file_name );
+    if ( entry == NULL ){
+        SDL_UnlockMutex( mutex );
+        return NULL;
+    }
+
+    // waiting for a decode in progress is cheaper than starting over
+    while ( entry->state == DECODING ) SDL_CondWait( cond, mutex );
+
+    SDL_Surface *surface = entry->surface;
+    if ( has_alpha ) *has_alpha = entry->has_alpha;
+    if ( location ) *location = entry->location;
+    entry->surface = NULL;
+    removeEntry( entry );
+    SDL_UnlockMutex( mutex );
+
+    return surface;
+}
+
+void ImagePrefetcher::remove( const char *file_name )
+{
+    if ( num_threads == 0 ) return;
+
+    SDL_LockMutex( mutex );
+    Entry *entry = findEntry( file_name );
+    if ( entry ){
+        // a decode in progress may have read the old contents
+        while ( entry->state == DECODING ) SDL_CondWait( cond, mutex );
+        removeEntry( entry );
+    }
+    SDL_UnlockMutex( mutex );
+}
+
+void ImagePrefetcher::clear()
+{
+    if ( num_threads == 0 ) return;
+
+    SDL_LockMutex( mutex );
+    while ( entry_list ){
+        Entry *entry = entry_list;
+        while ( entry && entry->state == DECODING ) entry = entry->next;
+        if ( entry )
+            removeEntry( entry );
+        else
+            SDL_CondWait( cond, mutex );
+    }
+    SDL_UnlockMutex( mutex );
+}
+
+int ImagePrefetcher::decodeLoop()
+{
+    SDL_LockMutex( mutex );
+    while ( !quit_flag ){
+        Entry *entry = entry_list;
+        while ( entry && entry->state != QUEUED ) entry = entry->next;
+        if ( entry == NULL ){
+            SDL_CondWait( cond, mutex );
+            continue;
+        }
+
+        entry->state = DECODING;
+        SDL_UnlockMutex( mutex );
+
+        SDL_Surface *surface = decode( entry );
+
+        SDL_LockMutex( mutex );
+        entry->surface = surface;
+        entry->size = surface ? surface->pitch * surface->h : 0;
+        entry->state = DONE;
+        total_size += entry->size;
+        while ( total_size > PREFETCH_MAX_BYTES && evictEntry( true ) );
+        SDL_CondBroadcast( cond );
+    }
+    SDL_UnlockMutex( mutex );
+
+    return 0;
+}
+
+ImagePrefetcher::Entry *ImagePrefetcher::findEntry( const char *file_name )
+{
+    Entry *entry = entry_list;
+    while ( entry && strcmp( entry->file_name, file_name ) ) entry = entry->next;
+
+    return entry;
+}
+
+void ImagePrefetcher::removeEntry( Entry *entry )
+{
+    Entry **p = &entry_list;
+    while ( *p != entry ) p = &(*p)->next;
+    *p = entry->next;
+
+    if ( entry->state == DONE ) total_size -= entry->size;
+    num_entries--;
+    delete entry;
+}
+
+// drop the oldest entry that no one is working on
+bool ImagePrefetcher::evictEntry( bool old_scan_only )
+{
+    Entry *entry = entry_list;
+    while ( entry &&
+            ( entry->state == DECODING ||
+              ( old_scan_only && entry->scan_no == scan_no ) ) )
+        entry = entry->next;
+    if ( entry == NULL ) return false;
+
+    removeEntry( entry );
+
+    return true;
+}
+
+// same as the first half of ONScripterLabel::loadImage()
+SDL_Surface *ImagePrefetcher::decode( Entry *entry )
+{
+    BaseReader *reader = entry->reader;
+    int location = BaseReader::ARCHIVE_TYPE_NONE;
+    size_t length = 0;
+    const unsigned char *map_buf = reader->getFileMap( entry->file_name, &length, &location );
+    unsigned char *buffer = NULL;
+
+    SDL_RWops *src;
+    if ( map_buf ){
+        src = SDL_RWFromConstMem( map_buf, length );
+    }
+    else{
+        length = reader->getFileLength( entry->file_name );
+        if ( length == 0 ) return NULL;
+        buffer = new unsigned char[length];
+        reader->getFile( entry->file_name, buffer, &location );
+        src = SDL_RWFromMem( buffer, length );
+    }
+
+    char *ext = strrchr( entry->file_name, '.' );
+    bool locked = lockLoader( src );
+    SDL_Surface *tmp = IMG_Load_RW( src, 0 );
+    if ( !tmp && ext && (!strcmp( ext+1, "JPG" ) || !strcmp( ext+1, "jpg" )) )
+        tmp = IMG_LoadJPG_RW( src );
+    unlockLoader( locked );
+    SDL_RWclose( src );
+    if ( buffer ) delete[] buffer;
+    if ( tmp == NULL ) return NULL;
+
+    entry->has_alpha = tmp->format->Amask;
+    entry->location = location;
+
+    SDL_Surface *ret = SDL_ConvertSurface( tmp, format, SDL_SWSURFACE );
+    SDL_FreeSurface( tmp );
+
+    return ret;
+}
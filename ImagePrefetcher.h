@@ -0,0 +1,111 @@
+/* -*- C++ -*-
+ *
+ *  ImagePrefetcher.h - Background decoding of images ahead of the script
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __IMAGE_PREFETCHER_H__
+#define __IMAGE_PREFETCHER_H__
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "BaseReader.h"
+
+#define MAX_PREFETCH_THREADS 8
+#define PREFETCH_MAX_ENTRIES 16
+#define PREFETCH_MAX_BYTES   (32*1024*1024)
+
+// Decodes the images named in the script text ahead of the current
+// line on worker threads.  A finished entry holds the image read
+// from the archive and converted to the pixel format given to
+// open(); it is handed over (and forgotten) by take().  Rescaling
+// and the PNG mask detection are left to the caller.
+//
+// The GIF and XPM loaders of SDL_image keep their decoding state in
+// statics, so every IMG_Load* call, on the workers and elsewhere, is
+// put between lockLoader() and unlockLoader(), which take the lock
+// only for an image in one of those formats.  The other loaders just
+// count their users, and initLoaders() holds them loaded from the
+// start so that the count never drops back to zero mid-decode.
+class ImagePrefetcher
+{
+public:
+    ImagePrefetcher();
+    ~ImagePrefetcher();
+
+    static void initLoaders();
+    static bool lockLoader( SDL_RWops *src );
+    static void unlockLoader( bool locked );
+
+    void open( SDL_PixelFormat *format, int num_threads );
+    void close();
+    bool isActive(){ return num_threads > 0; };
+
+    // entries requested before the last beginScan() may be evicted
+    // to make room for new requests
+    void beginScan();
+    bool request( const char *file_name, BaseReader *reader );
+    SDL_Surface *take( const char *file_name, bool *has_alpha, int *location );
+    void remove( const char *file_name ); // the file has been rewritten
+    void clear();
+
+    int decodeLoop();
+
+private:
+    enum { QUEUED, DECODING, DONE };
+
+    struct Entry{
+        Entry *next;
+        char *file_name;
+        BaseReader *reader;
+        int state;
+        int scan_no;
+        SDL_Surface *surface;
+        bool has_alpha;
+        int location;
+        size_t size;
+        Entry(){
+            next = NULL;
+            file_name = NULL;
+            reader = NULL;
+            surface = NULL;
+        };
+        ~Entry(){
+            if (file_name) delete[] file_name;
+            if (surface) SDL_FreeSurface(surface);
+        };
+    } *entry_list;
+
+    Entry *findEntry( const char *file_name );
+    void removeEntry( Entry *entry );
+    bool evictEntry( bool old_scan_only );
+    SDL_Surface *decode( Entry *entry );
+
+    static SDL_mutex *loader_mutex; // created by initLoaders()
+
+    SDL_PixelFormat *format;
+    SDL_Thread *thread[MAX_PREFETCH_THREADS];
+    int num_threads;
+    SDL_mutex *mutex;
+    SDL_cond *cond; // signalled when an entry is queued or finished
+    bool quit_flag;
+
+    int num_entries;
+    size_t total_size;
+    int scan_no;
+};
+
+#endif // __IMAGE_PREFETCHER_H__
@@ -0,0 +1,127 @@
+/* -*- C++ -*-
+ *
+ *  LRUCache.cpp - Hash table, LRU order and byte budget of the caches
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "LRUCache.h"
+
+LRUCache::LRUCache( const char *name, const char *entry_name,
+                    int hash_size, size_t budget, bool keep_latest )
+{
+    this->name = name;
+    this->entry_name = entry_name;
+    this->hash_size = hash_size;
+    this->budget = budget;
+    this->keep_latest = keep_latest;
+
+    hash_table = new Entry*[hash_size];
+    for ( int i=0 ; i<hash_size ; i++ ) hash_table[i] = NULL;
+    lru_head = lru_tail = NULL;
+
+    total_size = 0;
+    num_hits = 0;
+    num_misses = 0;
+    num_evictions = 0;
+}
+
+LRUCache::~LRUCache()
+{
+    clear();
+    delete[] hash_table;
+}
+
+void LRUCache::setBudget( size_t bytes )
+{
+    budget = bytes;
+    while ( lru_tail && !(keep_latest && lru_tail == lru_head) &&
+            total_size > budget ){
+        removeEntry( lru_tail );
+        num_evictions++;
+    }
+}
+
+void LRUCache::clear()
+{
+    while ( lru_head ) removeEntry( lru_head );
+}
+
+void LRUCache::dumpStats( FILE *fp )
+{
+    int num = 0;
+    for ( Entry *entry = lru_head ; entry ; entry = entry->next ) num++;
+
+    unsigned long total = num_hits + num_misses;
+    fprintf( fp, "%s cache: %lu hits, %lu misses (%lu%% hit rate), %lu evictions, %d %s, %lu / %lu bytes\n",
+             name, num_hits, num_misses, total ? num_hits * 100 / total : 0,
+             num_evictions, num, entry_name,
+             (unsigned long)total_size, (unsigned long)budget );
+}
+
+// count a hit and move the entry to the front of the LRU list
+void LRUCache::hit( Entry *entry )
+{
+    num_hits++;
+    if ( entry == lru_head ) return;
+
+    unlinkEntry( entry );
+    entry->prev = NULL;
+    entry->next = lru_head;
+    lru_head->prev = entry;
+    lru_head = entry;
+}
+
+// Make room for entry within the budget and add it as the most
+// recent one.  The cache owns it from then on.
+void LRUCache::insert( Entry *entry )
+{
+    while ( lru_tail && total_size + entry->size > budget ){
+        removeEntry( lru_tail );
+        num_evictions++;
+    }
+
+    int i = entry->hash & (hash_size-1);
+    entry->hash_next = hash_table[i];
+    hash_table[i] = entry;
+
+    entry->prev = NULL;
+    entry->next = lru_head;
+    if ( lru_head ) lru_head->prev = entry;
+    lru_head = entry;
+    if ( lru_tail == NULL ) lru_tail = entry;
+
+    total_size += entry->size;
+}
+
+void LRUCache::unlinkEntry( Entry *entry )
+{
+    if ( entry->prev ) entry->prev->next = entry->next;
+    else               lru_head = entry->next;
+    if ( entry->next ) entry->next->prev = entry->prev;
+    else               lru_tail = entry->prev;
+}
+
+void LRUCache::removeEntry( Entry *entry )
+{
+    unlinkEntry( entry );
+
+    Entry **p = &hash_table[entry->hash & (hash_size-1)];
+    while ( *p != entry ) p = &(*p)->hash_next;
+    *p = entry->hash_next;
+
+    total_size -= entry->size;
+    delete entry;
+}
@@ -0,0 +1,79 @@
+/* -*- C++ -*-
+ *
+ *  LRUCache.h - Hash table, LRU order and byte budget of the caches
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __LRU_CACHE_H__
+#define __LRU_CACHE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+// What ImageCache, GlyphCache and SoundCache have in common.  A cache
+// derives its entries from LRUCache::Entry, adding the key and the
+// payload; it sets the hash of the key and the size of the payload in
+// bytes before insert(), and compares the keys itself while walking
+// bucket().  Least recently used entries are dropped once the total
+// size exceeds the budget.
+class LRUCache
+{
+public:
+    LRUCache( const char *name, const char *entry_name,
+              int hash_size, size_t budget, bool keep_latest );
+    virtual ~LRUCache();
+
+    void setBudget( size_t bytes );
+    bool isActive(){ return budget > 0; };
+    void clear();
+
+    unsigned long getHits(){ return num_hits; };
+    unsigned long getMisses(){ return num_misses; };
+    unsigned long getEvictions(){ return num_evictions; };
+    size_t getTotalSize(){ return total_size; };
+    void dumpStats( FILE *fp );
+
+protected:
+    struct Entry{
+        Entry *hash_next;
+        Entry *prev, *next; // LRU order, most recent first
+        unsigned int hash;
+        size_t size;
+        virtual ~Entry(){};
+    };
+
+    Entry *bucket( unsigned int hash ){ return hash_table[hash & (hash_size-1)]; };
+    void hit( Entry *entry );
+    void insert( Entry *entry );
+    void removeEntry( Entry *entry );
+
+    Entry *lru_head, *lru_tail;
+    size_t budget;
+    size_t total_size;
+    unsigned long num_hits;
+    unsigned long num_misses;
+    unsigned long num_evictions;
+
+private:
+    void unlinkEntry( Entry *entry );
+
+    const char *name, *entry_name; // for dumpStats()
+    Entry **hash_table;
+    int hash_size; // a power of two
+    bool keep_latest; // setBudget() keeps the most recent entry
+};
+
+#endif // __LRU_CACHE_H__
@@ -22,6 +22,7 @@
 #ifndef BPP16
 
 #include "Layer.h"
+#include "ImagePrefetcher.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -544,15 +545,18 @@ static SDL_Surface *loadImage( char *file_name, bool *has_alpha, SDL_Surface *su
     unsigned char *buffer = new unsigned char[length];
     int location;
     br->getFile( file_name, buffer, &location );
-    SDL_Surface *tmp = IMG_Load_RW(SDL_RWFromMem( buffer, length ), 1);
+    SDL_RWops *src = SDL_RWFromMem( buffer, length );
+    bool locked = ImagePrefetcher::lockLoader(src);
+    SDL_Surface *tmp = IMG_Load_RW(src, 0);
 
     char *ext = strrchr(file_name, '.');
     if ( !tmp && ext && (!strcmp( ext+1, "JPG" ) || !strcmp( ext+1, "jpg" ) ) ){
         fprintf( stderr, " *** force-loading a JPG image [%s]\n", file_name );
-        SDL_RWops *src = SDL_RWFromMem( buffer, length );
+        SDL_RWseek(src, 0, SEEK_SET);
         tmp = IMG_LoadJPG_RW(src);
-        SDL_RWclose(src);
     }
+    ImagePrefetcher::unlockLoader(locked);
+    SDL_RWclose(src);
     if ( tmp && has_alpha ) *has_alpha = tmp->format->Amask;
 
     delete[] buffer;
@@ -22,6 +22,7 @@
  */
 
 #include "MadWrapper.h"
+#include "AudioGain.h"
 #include <mad.h>
 
 #define DEFAULT_AUDIOBUF  4096
@@ -44,7 +45,8 @@ struct _MAD_WRAPPER{
     struct mad_frame  Frame;
     struct mad_synth  Synth;
     bool is_playing;
-    int volume;
+    int volume; // Q15
+    int gain; // Q15, at the end of the last buffer played
 
     unsigned char *input_buf;
     unsigned char *output_buf;
@@ -66,7 +68,7 @@ static MAD_WRAPPER* init( SDL_RWops *src )
 	mad_stream_init( &mad->Stream );
 	mad_frame_init( &mad->Frame );
 	mad_synth_init( &mad->Synth );
-    mad->volume = 64;
+    mad->volume = mad->gain = GAIN_UNITY / 2;
     
     mad->input_buf = new unsigned char[ INPUT_BUFFER_SIZE ];
     mad->output_buf = new unsigned char[ 1152*4*5 ]; /* 1152 because that's what mad has as a max; *4 because */
@@ -173,16 +175,15 @@ int MAD_WRAPPER_playAudio( void *userdata, Uint8 *stream, int len )
 
     if ( ReadSize <= 0 ) return 0; // end of stream
 
-    if ( mad->output_buf_index > len ){
-        SDL_MixAudio( stream, mad->output_buf, len, mad->volume );
-        memmove( mad->output_buf, mad->output_buf + len, mad->output_buf_index - len );
-        mad->output_buf_index -= len;
-    }
-    else{
-        SDL_MixAudio( stream, mad->output_buf, mad->output_buf_index, mad->volume );
-        len = mad->output_buf_index;
-        mad->output_buf_index = 0;
-    }
+    if ( len > mad->output_buf_index ) len = mad->output_buf_index;
+
+    // the stream is silence when passed in, so the samples are copied
+    // rather than mixed
+    applyGain( (Sint16*)mad->output_buf, len / 2, mad->gain, mad->volume );
+    mad->gain = mad->volume;
+    memcpy( stream, mad->output_buf, len );
+    memmove( mad->output_buf, mad->output_buf + len, mad->output_buf_index - len );
+    mad->output_buf_index -= len;
 
     return len;
 }
@@ -212,7 +213,7 @@ void MAD_WRAPPER_delete( MAD_WRAPPER *mad )
 void MAD_WRAPPER_setvolume( MAD_WRAPPER *mad, int volume )
 {
     if ( (volume >= 0) && (volume <= 100) ) {
-        mad->volume = (volume*SDL_MIX_MAXVOLUME) / 100;
+        mad->volume = volumeToGain( volume );
     }
 }
 
@@ -97,6 +97,7 @@ int NsaReader::open( const char *nsa_path, int archive_type )
         return -1;
     } else {
         num_of_nsa_archives = i+1;
+        buildFileIndex();
         return 0;
     }
 }
@@ -110,6 +111,7 @@ int NsaReader::openForConvert( const char *nsa_name, int archive_type )
     }
 
     readArchive( &archive_info_nsa, archive_type );
+    buildFileIndex();
 
     return 0;
 }
@@ -142,41 +144,37 @@ int NsaReader::getNumFiles(){
     return total;
 }
 
-size_t NsaReader::getFileLengthSub( ArchiveInfo *ai, const char *file_name )
+void NsaReader::buildFileIndex()
 {
-    unsigned int i = getIndexFromFile( ai, file_name );
-
-    if ( i == ai->num_of_files ) return 0;
-
-    if ( ai->fi_list[i].compression_type == NO_COMPRESSION ){
-        int type = getRegisteredCompressionType( file_name );
-        if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION )
-            return getDecompressedFileLength( type, ai->file_handle, ai->fi_list[i].offset );
+    // same search order as before: arc.nsa, arc1.nsa, ..., then arc.sar
+    clearFileIndex();
+
+    addFileIndex( &archive_info_nsa );
+    for ( int i=0 ; i<num_of_nsa_archives-1 ; i++ )
+        addFileIndex( &archive_info2[i] );
+
+    if ( sar_flag ){
+        ArchiveInfo *info = archive_info.next;
+        for ( int i=0 ; i<num_of_sar_archives ; i++ ){
+            addFileIndex( info );
+            info = info->next;
+        }
     }
-    
-    return ai->fi_list[i].original_length;
 }
 
 size_t NsaReader::getFileLength( const char *file_name )
 {
     size_t ret;
-    int i;
     
     // direct read
     if ( ( ret = DirectReader::getFileLength( file_name ) ) ) return ret;
     
-    // nsa read
-    if ( ( ret = getFileLengthSub( &archive_info_nsa, file_name )) ) return ret;
+    // nsa, nsa? and sar read
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
+    if ( !info ) return 0;
 
-    // nsa? read
-    for ( i=0 ; i<num_of_nsa_archives-1 ; i++ ){
-        if ( (ret = getFileLengthSub( &archive_info2[i], file_name )) ) return ret;
-    }
-    
-    // sar read
-    if ( sar_flag ) return SarReader::getFileLength( file_name );
-
-    return 0;
+    return getFileLengthSub( info, no, file_name );
 }
 
 size_t NsaReader::getFile( const char *file_name, unsigned char *buffer, int *location )
@@ -186,24 +184,38 @@ size_t NsaReader::getFile( const char *file_name, unsigned char *buffer, int *lo
     // direct read
     if ( ( ret = DirectReader::getFile( file_name, buffer, location ) ) ) return ret;
 
-    // nsa read
-    if ( (ret = getFileSub( &archive_info_nsa, file_name, buffer )) ){
-        if ( location ) *location = ARCHIVE_TYPE_NSA;
-        return ret;
-    }
+    // nsa, nsa? and sar read
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
+    if ( !info ) return 0;
 
-    // nsa? read
-    for ( int i=0 ; i<num_of_nsa_archives ; i++ ){
-        if ( (ret = getFileSub( &archive_info2[i], file_name, buffer )) ){
-            if ( location ) *location = ARCHIVE_TYPE_NSA;
-            return ret;
-        }
-    }
+    if ( location ) *location = getLocation( info );
 
-    // sar read
-    if ( sar_flag ) return SarReader::getFile( file_name, buffer, location );
+    return getFileSub( info, no, file_name, buffer );
+}
 
-    return 0;
+const unsigned char *NsaReader::getFileMap( const char *file_name, size_t *length, int *location )
+{
+    // a loose file takes precedence, as in getFile()
+    if ( DirectReader::getFileLength( file_name ) ) return NULL;
+
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
+    if ( !info ) return NULL;
+
+    const unsigned char *buf = getFileMapSub( info, no, file_name, length );
+    if ( buf && location ) *location = getLocation( info );
+
+    return buf;
+}
+
+int NsaReader::getLocation( ArchiveInfo *ai )
+{
+    if ( ai == &archive_info_nsa ||
+         ( ai >= archive_info2 && ai < archive_info2 + MAX_EXTRA_ARCHIVE ) )
+        return ARCHIVE_TYPE_NSA;
+
+    return ARCHIVE_TYPE_SAR;
 }
 
 struct NsaReader::FileInfo NsaReader::getFileByIndex( unsigned int index )
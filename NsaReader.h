@@ -39,6 +39,7 @@ public:
     
     size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buf, int *location=NULL );
+    const unsigned char *getFileMap( const char *file_name, size_t *length, int *location=NULL );
     struct FileInfo getFileByIndex( unsigned int index );
 
     int openForConvert( const char *nsa_name, int archive_type=ARCHIVE_TYPE_NSA );
@@ -52,7 +53,8 @@ private:
     int num_of_nsa_archives;
     const char *nsa_archive_ext;
 
-    size_t getFileLengthSub( ArchiveInfo *ai, const char *file_name );
+    void buildFileIndex();
+    int getLocation( ArchiveInfo *ai );
 };
 
 #endif // __NSA_READER_H__
@@ -30,6 +30,7 @@
 // Ogapee's 20090331 release source code.
 
 #include "ONScripterLabel.h"
+#include "HashIndex.h"
 #include <cstdio>
 
 #ifdef MACOSX
@@ -297,6 +298,28 @@ static struct FuncLUT{
     {"", NULL}
 };
 
+// open-addressed index into func_lut; holds index+1, 0 if empty
+#define FUNC_LUT_HASH_SIZE 1024
+static short func_lut_hash[FUNC_LUT_HASH_SIZE];
+static bool func_lut_hash_flag = false;
+
+static void initFuncLUTHash()
+{
+    if ( func_lut_hash_flag ) return;
+    func_lut_hash_flag = true;
+
+    for ( int i=0 ; func_lut[i].method ; i++ )
+        addHashIndex( func_lut_hash, FUNC_LUT_HASH_SIZE, func_lut, &FuncLUT::command, i );
+}
+
+static FuncList findFuncLUT( const char *cmd )
+{
+    int i = findHashIndex( func_lut_hash, FUNC_LUT_HASH_SIZE, func_lut, &FuncLUT::command, cmd );
+    if ( i >= 0 ) return func_lut[i].method;
+
+    return NULL;
+}
+
 static void SDL_Quit_Wrapper()
 {
     SDL_Quit();
@@ -334,6 +357,8 @@ void ONScripterLabel::initSDL()
         exit(-1);
     }
 
+    ImagePrefetcher::initLoaders();
+
 #ifdef INSANI
 	SDL_WM_SetIcon(IMG_Load("icon.png"), NULL);
 	//fprintf(stderr, "Autodetect: insanity spirit detected!\n");
@@ -482,6 +507,8 @@ void ONScripterLabel::openAudio(int freq, Uint16 format, int channels)
 
 ONScripterLabel::ONScripterLabel()
 {
+    initFuncLUTHash();
+
 #if defined (USE_X86_GFX) && !defined(MACOSX)
     // determine what functions the cpu supports (Mion)
     {
@@ -501,6 +528,16 @@ ONScripterLabel::ONScripterLabel()
                 func |= AnimationInfo::CPUF_X86_SSE2;
                 printf("SSE2, ");
             }
+            // AVX2 also needs the OS to save the YMM registers
+            if ((ecx & bit_OSXSAVE) && __get_cpuid_max(0, NULL) >= 7) {
+                unsigned int xcr0_lo, xcr0_hi;
+                __asm__ __volatile__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+                __cpuid_count(7, 0, eax, ebx, ecx, edx);
+                if ((xcr0_lo & 0x6) == 0x6 && (ebx & bit_AVX2)) {
+                    func |= AnimationInfo::CPUF_X86_AVX2;
+                    printf("AVX2, ");
+                }
+            }
             printf("\n");
         }
         AnimationInfo::setCpufuncs(func);
@@ -538,6 +575,13 @@ ONScripterLabel::ONScripterLabel()
 #endif
     cdrom_drive_number = 0;
     cdaudio_flag = false;
+    prefetch_threads = DEFAULT_PREFETCH_THREADS;
+    image_cache.setBudget( DEFAULT_IMAGE_CACHE_SIZE*1024*1024 );
+    compositor_threads = 0;
+    preload_glyphs_flag = false;
+    text_flush_pending = false;
+    text_flush_time = 0;
+    prefetch_scan_start = prefetch_scan_end = NULL;
     default_font = NULL;
     registry_file = NULL;
     setStr( &registry_file, REGISTRY_FILE );
@@ -552,19 +596,14 @@ ONScripterLabel::ONScripterLabel()
     window_mode = false;
     sprite_info  = new AnimationInfo[MAX_SPRITE_NUM];
     sprite2_info = new AnimationInfo[MAX_SPRITE2_NUM];
+    sprite_index.open( sprite_info, MAX_SPRITE_NUM );
+    sprite2_index.open( sprite2_info, MAX_SPRITE2_NUM );
     current_button_state.down_flag = false;
     current_button_state.reset();
 
     int i;
     for (i=0 ; i<MAX_SPRITE2_NUM ; i++)
         sprite2_info[i].affine_flag = true;
-    for (i=0 ; i<NUM_GLYPH_CACHE ; i++){
-        if (i != NUM_GLYPH_CACHE-1) glyph_cache[i].next = &glyph_cache[i+1];
-        glyph_cache[i].font = NULL;
-        glyph_cache[i].surface = NULL;
-    }
-    glyph_cache[NUM_GLYPH_CACHE-1].next = NULL;
-    root_glyph_cache = &glyph_cache[0];
     string_buffer_breaks = NULL;
     string_buffer_margins = NULL;
     line_has_nonspace = false;
@@ -822,6 +861,7 @@ int ONScripterLabel::init()
     image_surface = SDL_CreateRGBSurface( SDL_SWSURFACE, 1, 1, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 );
 
     accumulation_surface = AnimationInfo::allocSurface( screen_width, screen_height );
+    dirty_rect.setSize( screen_width, screen_height );
     backup_surface       = AnimationInfo::allocSurface( screen_width, screen_height );
     effect_src_surface   = AnimationInfo::allocSurface( screen_width, screen_height );
     effect_dst_surface   = AnimationInfo::allocSurface( screen_width, screen_height );
@@ -838,6 +878,10 @@ int ONScripterLabel::init()
     mean_size_of_loaded_images = 0;
     num_loaded_images = 10; // to suppress temporal increase at the start-up
 
+    image_prefetcher.open( image_surface->format, prefetch_threads );
+    band_renderer.open( compositor_threads );
+    AnimationInfo::setMultiThreaded( band_renderer.isActive() );
+
     text_info.num_of_cells = 1;
     text_info.allocImage( screen_width, screen_height );
     text_info.fill(0, 0, 0, 0);
@@ -907,13 +951,16 @@ int ONScripterLabel::init()
     sin_table = cos_table = NULL;
     whirl_table = NULL;
     breakup_cells = NULL;
-    breakup_mask = breakup_cellforms = NULL;
+    breakup_mask = NULL;
+    breakup_cellforms = NULL;
 
     internal_timer = SDL_GetTicks();
 
     trap_dist = NULL;
     resize_buffer = new unsigned char[16];
     resize_buffer_size = 16;
+    mask_row_buffer = NULL;
+    mask_row_buffer_size = 0;
 
     skip_mode = SKIP_NONE;
 
@@ -984,6 +1031,12 @@ void ONScripterLabel::reset()
         resize_buffer = new unsigned char[16];
         resize_buffer_size = 16;
     }
+    if (mask_row_buffer) delete[] mask_row_buffer;
+    mask_row_buffer = NULL;
+    mask_row_buffer_size = 0;
+
+    image_prefetcher.clear();
+    prefetch_scan_start = prefetch_scan_end = NULL;
 
     current_over_button = 0;
     variable_edit_mode = NOT_EDIT_MODE;
@@ -1165,24 +1218,22 @@ void ONScripterLabel::flush( int refresh_mode, SDL_Rect *rect, bool clear_dirty_
     else{
         if ( rect ) dirty_rect.add( *rect );
 
-        if ( dirty_rect.area > 0 ){
-            if ( dirty_rect.area >= dirty_rect.bounding_box.w * dirty_rect.bounding_box.h ){
-                flushDirect( dirty_rect.bounding_box, refresh_mode );
-            } else {
-                for (int i = 0; i < dirty_rect.num_history; ++i)
-                    flushDirect( dirty_rect.history[i], refresh_mode, false );
-                if (surround_rects) {
-                    // playing a movie, need to avoid overpainting it
-                    int n = dirty_rect.num_history;
-                    SDL_Rect tmp_rects[n * 4];
-                    for (int i=0; i<4; ++i) {
-                        for (int j = 0; j < n; ++j)
-                            intersectRects(tmp_rects[i*n + j], dirty_rect.history[j], surround_rects[i]);
-                    }
-                    SDL_UpdateRects( screen_surface, n*4, tmp_rects );
-                } else {
-                    SDL_UpdateRects( screen_surface, dirty_rect.num_history, dirty_rect.history );
+        int n = dirty_rect.calcRects();
+        if ( n == 1 ){
+            flushDirect( dirty_rect.rects[0], refresh_mode );
+        } else if ( n > 1 ){
+            for (int i = 0; i < n; ++i)
+                flushDirect( dirty_rect.rects[i], refresh_mode, false );
+            if (surround_rects) {
+                // playing a movie, need to avoid overpainting it
+                SDL_Rect tmp_rects[n * 4];
+                for (int i=0; i<4; ++i) {
+                    for (int j = 0; j < n; ++j)
+                        intersectRects(tmp_rects[i*n + j], dirty_rect.rects[j], surround_rects[i]);
                 }
+                SDL_UpdateRects( screen_surface, n*4, tmp_rects );
+            } else {
+                SDL_UpdateRects( screen_surface, n, dirty_rect.rects );
             }
         }
     }
@@ -1211,6 +1262,15 @@ void ONScripterLabel::flushDirect( SDL_Rect &rect, int refresh_mode, bool update
     }
 }
 
+void ONScripterLabel::flushText()
+{
+    if ( text_flush_pending ){
+        flushDirect( text_flush_rect, REFRESH_NONE_MODE );
+        text_flush_pending = false;
+    }
+    text_flush_time = SDL_GetTicks();
+}
+
 void ONScripterLabel::mouseOverCheck( int x, int y )
 {
     int c = -1;
@@ -1371,6 +1431,9 @@ void ONScripterLabel::executeLabel()
 
         if ( kidokuskip_flag && skip_mode & SKIP_NORMAL && kidokumode_flag && !script_h.isKidoku() ) skip_mode &= ~SKIP_NORMAL;
 
+        if ( image_prefetcher.isActive() && current_mode == NORMAL_MODE )
+            prefetchImages();
+
         char *current = script_h.getCurrent();
         int ret = ScriptParser::parseLine();
         if ( ret == RET_NOMATCH ) ret = this->parseLine();
@@ -1408,18 +1471,17 @@ void ONScripterLabel::executeLabel()
 
 int ONScripterLabel::parseLine( )
 {
-    int ret, lut_counter = 0;
+    int ret;
     const char *s_buf = script_h.getStringBuffer();
     const char *cmd = script_h.getStringBuffer();
     if (cmd[0] == '_') cmd++;
 
     if ( !script_h.isText() ){
-        while( func_lut[ lut_counter ].method ){
-            if ( !strcmp( func_lut[ lut_counter ].command, cmd ) ){
-                return (this->*func_lut[ lut_counter ].method)();
-            }
-            lut_counter++;
-        }
+        // commands see the screen as the text output left it
+        if ( text_flush_pending ) flushText();
+
+        FuncList method = findFuncLUT( cmd );
+        if ( method ) return (this->*method)();
 
         if ( s_buf[0] == 0x0a )
             return RET_CONTINUE;
@@ -1445,90 +1507,20 @@ int ONScripterLabel::parseLine( )
 
 SDL_Surface *ONScripterLabel::loadImage( char *file_name, bool *has_alpha )
 {
-    char* alt_buffer = 0;
     if ( !file_name ) return NULL;
-    unsigned long length = script_h.cBR->getFileLength( file_name );
-
-    if (length == 0) {
-	alt_buffer = new char[strlen(file_name) + strlen(script_h.save_path) + 1];
-	sprintf(alt_buffer, "%s%s", script_h.save_path, file_name);
-	char* si = alt_buffer;
-	do { if (*si == '\\') *si = DELIMITER; } while (*(++si));
-	FILE* fp = std::fopen(alt_buffer, "rb");
-	if (fp) {
-	    fseek(fp, 0, SEEK_END);
-	    length = ftell(fp);
-	    fclose(fp);
-	}
-	else delete[] alt_buffer;
-    }
-
-    if ( length == 0 ){
-        if (strcmp(file_name, "uoncur.bmp" ) &&
-	    strcmp(file_name, "uoffcur.bmp") &&
-	    strcmp(file_name, "doncur.bmp" ) &&
-	    strcmp(file_name, "doffcur.bmp") &&
-	    strcmp(file_name, "cursor0.bmp") &&
-	    strcmp(file_name, "cursor1.bmp"))
-            fprintf( stderr, " *** can't find file [%s] ***\n", file_name );
-        return NULL;
-    }
-    if ( filelog_flag )
-        script_h.findAndAddLog( script_h.log_info[ScriptHandler::FILE_LOG], file_name, true );
-    //printf(" ... loading %s length %ld\n", file_name, length );
-
-    mean_size_of_loaded_images += length*6/5; // reserve 20% larger size
-    num_loaded_images++;
-    if (tmp_image_buf_length < mean_size_of_loaded_images/num_loaded_images){
-        tmp_image_buf_length = mean_size_of_loaded_images/num_loaded_images;
-        if (tmp_image_buf) delete[] tmp_image_buf;
-        tmp_image_buf = NULL;
-    }
 
-    unsigned char *buffer = NULL;
-    if (length > tmp_image_buf_length){
-        buffer = new unsigned char[length];
+    int location = BaseReader::ARCHIVE_TYPE_NONE;
+    SDL_Surface *ret = image_prefetcher.take( file_name, has_alpha, &location );
+    if ( ret ){
+        if ( filelog_flag )
+            script_h.findAndAddLog( script_h.log_info[ScriptHandler::FILE_LOG], file_name, true );
     }
     else{
-        if (!tmp_image_buf) tmp_image_buf = new unsigned char[tmp_image_buf_length];
-        buffer = tmp_image_buf;
-    }
-
-    int location;
-    if (!alt_buffer) {
-	script_h.cBR->getFile( file_name, buffer, &location );
-    }
-    else {
-	FILE* fp;
-        if ((fp = std::fopen(alt_buffer, "rb"))) {
-            if (fread(buffer, 1, length, fp) != length)
-                fprintf(stderr, "Warning: error reading from %s\n", alt_buffer);
-            fclose(fp);
-        }
-	delete[] alt_buffer;
-    }
-    char *ext = strrchr(file_name, '.');
-
-    SDL_RWops *src = SDL_RWFromMem(buffer, length);
-    SDL_Surface *tmp = IMG_Load_RW(src, 0);
-    if (!tmp && ext && (!strcmp(ext+1, "JPG") || !strcmp(ext+1, "jpg"))){
-        fprintf(stderr, " *** force-loading a JPG image [%s]\n", file_name);
-        tmp = IMG_LoadJPG_RW(src);
-
-    }
-    SDL_RWclose(src);
-
-    if ( tmp && has_alpha ) *has_alpha = tmp->format->Amask;
-
-    if (buffer != tmp_image_buf) delete[] buffer;
-    if (!tmp){
-        fprintf( stderr, " *** can't load file [%s] ***\n", file_name );
-        return NULL;
+        ret = decodeImage( file_name, has_alpha, &location );
+        if ( !ret ) return NULL;
     }
 
-    SDL_Surface *ret = SDL_ConvertSurface( tmp, image_surface->format, SDL_SWSURFACE );
-    if ( ret &&
-         screen_ratio2 != screen_ratio1 &&
+    if ( screen_ratio2 != screen_ratio1 &&
          (!disable_rescale_flag || location == BaseReader::ARCHIVE_TYPE_NONE) )
     {
         SDL_Surface *src_s = ret;
@@ -1543,7 +1535,6 @@ SDL_Surface *ONScripterLabel::loadImage( char *file_name, bool *has_alpha )
         resizeSurface( src_s, ret );
         SDL_FreeSurface( src_s );
     }
-    SDL_FreeSurface( tmp );
 
 #ifndef BPP16
     // Hack to detect when a PNG image is likely to have an old-style
@@ -1585,6 +1576,195 @@ SDL_Surface *ONScripterLabel::loadImage( char *file_name, bool *has_alpha )
     return ret;
 }
 
+// Read an image from the archives (or the save directory) and
+// convert it to the format of image_surface.
+SDL_Surface *ONScripterLabel::decodeImage( char *file_name, bool *has_alpha, int *location )
+{
+    char* alt_buffer = 0;
+
+    // uncompressed files in a mapped archive are decoded in place
+    size_t map_length = 0;
+    const unsigned char *map_buf = script_h.cBR->getFileMap( file_name, &map_length, location );
+    unsigned long length = map_buf ? map_length : script_h.cBR->getFileLength( file_name );
+
+    if (length == 0) {
+	alt_buffer = new char[strlen(file_name) + strlen(script_h.save_path) + 1];
+	sprintf(alt_buffer, "%s%s", script_h.save_path, file_name);
+	char* si = alt_buffer;
+	do { if (*si == '\\') *si = DELIMITER; } while (*(++si));
+	FILE* fp = std::fopen(alt_buffer, "rb");
+	if (fp) {
+	    fseek(fp, 0, SEEK_END);
+	    length = ftell(fp);
+	    fclose(fp);
+	}
+	else delete[] alt_buffer;
+    }
+
+    if ( length == 0 ){
+        if (strcmp(file_name, "uoncur.bmp" ) &&
+	    strcmp(file_name, "uoffcur.bmp") &&
+	    strcmp(file_name, "doncur.bmp" ) &&
+	    strcmp(file_name, "doffcur.bmp") &&
+	    strcmp(file_name, "cursor0.bmp") &&
+	    strcmp(file_name, "cursor1.bmp"))
+            fprintf( stderr, " *** can't find file [%s] ***\n", file_name );
+        return NULL;
+    }
+    if ( filelog_flag )
+        script_h.findAndAddLog( script_h.log_info[ScriptHandler::FILE_LOG], file_name, true );
+    //printf(" ... loading %s length %ld\n", file_name, length );
+
+    unsigned char *buffer = NULL;
+    SDL_RWops *src;
+    if (map_buf) {
+        src = SDL_RWFromConstMem(map_buf, length);
+    }
+    else {
+        mean_size_of_loaded_images += length*6/5; // reserve 20% larger size
+        num_loaded_images++;
+        if (tmp_image_buf_length < mean_size_of_loaded_images/num_loaded_images){
+            tmp_image_buf_length = mean_size_of_loaded_images/num_loaded_images;
+            if (tmp_image_buf) delete[] tmp_image_buf;
+            tmp_image_buf = NULL;
+        }
+
+        if (length > tmp_image_buf_length){
+            buffer = new unsigned char[length];
+        }
+        else{
+            if (!tmp_image_buf) tmp_image_buf = new unsigned char[tmp_image_buf_length];
+            buffer = tmp_image_buf;
+        }
+
+        if (!alt_buffer) {
+	    script_h.cBR->getFile( file_name, buffer, location );
+        }
+        else {
+	    FILE* fp;
+            if ((fp = std::fopen(alt_buffer, "rb"))) {
+                if (fread(buffer, 1, length, fp) != length)
+                    fprintf(stderr, "Warning: error reading from %s\n", alt_buffer);
+                fclose(fp);
+            }
+	    delete[] alt_buffer;
+        }
+        src = SDL_RWFromMem(buffer, length);
+    }
+    char *ext = strrchr(file_name, '.');
+
+    bool locked = ImagePrefetcher::lockLoader(src);
+    SDL_Surface *tmp = IMG_Load_RW(src, 0);
+    if (!tmp && ext && (!strcmp(ext+1, "JPG") || !strcmp(ext+1, "jpg"))){
+        fprintf(stderr, " *** force-loading a JPG image [%s]\n", file_name);
+        tmp = IMG_LoadJPG_RW(src);
+
+    }
+    ImagePrefetcher::unlockLoader(locked);
+    SDL_RWclose(src);
+
+    if ( tmp && has_alpha ) *has_alpha = tmp->format->Amask;
+
+    if (buffer != tmp_image_buf) delete[] buffer;
+    if (!tmp){
+        fprintf( stderr, " *** can't load file [%s] ***\n", file_name );
+        return NULL;
+    }
+
+    SDL_Surface *ret = SDL_ConvertSurface( tmp, image_surface->format, SDL_SWSURFACE );
+    SDL_FreeSurface( tmp );
+
+    return ret;
+}
+
+static bool isImageName( const char *name )
+{
+    static const char *image_ext[] = { "bmp", "jpg", "jpeg", "png", "gif", NULL };
+
+    const char *ext = strrchr( name, '.' );
+    if ( ext == NULL ) return false;
+    ext++;
+
+    for ( int i=0 ; image_ext[i] ; i++ ){
+        int j;
+        for ( j=0 ; image_ext[i][j] ; j++ )
+            if ( ext[j] != image_ext[i][j] && ext[j] != image_ext[i][j] + 'A' - 'a' ) break;
+        if ( image_ext[i][j] == '\0' && ext[j] == '\0' ) return true;
+    }
+
+    return false;
+}
+
+// Hand the image names found in the script text ahead of the
+// current position (up to the next label) to the prefetcher.
+// Nothing is rescanned until the script leaves the scanned range.
+void ONScripterLabel::prefetchImages()
+{
+    char *buf = script_h.getNext();
+    if ( buf >= prefetch_scan_start && buf < prefetch_scan_end ) return;
+    if ( !script_h.isInScript( buf ) ) return;
+
+    image_prefetcher.beginScan();
+    prefetch_scan_start = buf;
+
+    char *end = script_h.getScriptEnd();
+    if ( end - buf > PREFETCH_LOOKAHEAD ) end = buf + PREFETCH_LOOKAHEAD;
+
+    char name[256];
+    while ( buf < end ){
+        if ( *buf == '"' ){
+            char *start = ++buf;
+            while ( buf < end && *buf != '"' && *buf != 0x0a ) buf++;
+            if ( buf >= end || *buf != '"' ) continue;
+            buf++;
+
+            int len = buf - start - 1;
+            if ( len == 0 || len >= 256 ) continue;
+            memcpy( name, start, len );
+            name[len] = '\0';
+
+            // strip a tag such as ":a;" or ":a/2,100,0;", keeping
+            // the mask file of ":m<mask>;"
+            char *p = name;
+            if ( p[0] == ':' ){
+                while ( *++p == ' ' );
+                char *mask = NULL;
+                if ( p[0] == 'm' ) mask = p+1;
+                while ( *p != ';' && *p != '\0' ) p++;
+                if ( *p == '\0' ) continue;
+                *p++ = '\0';
+                if ( mask && isImageName( mask ) &&
+                     !image_prefetcher.request( mask, script_h.cBR ) ){
+                    buf = start - 1;
+                    break;
+                }
+            }
+
+            if ( isImageName( p ) &&
+                 !image_prefetcher.request( p, script_h.cBR ) ){
+                buf = start - 1; // come back to this one later
+                break;
+            }
+        }
+        else if ( *buf == ';' ){
+            while ( buf < end && *buf != 0x0a ) buf++;
+        }
+        else if ( *buf == 0x0a ){
+            buf++;
+            while ( buf < end && (*buf == ' ' || *buf == '\t') ) buf++;
+            if ( buf < end && *buf == '*' ) break;
+        }
+        else if ( IS_TWO_BYTE(*buf) ){
+            buf += 2;
+        }
+        else{
+            buf++;
+        }
+    }
+
+    prefetch_scan_end = buf;
+}
+
 /* ---------------------------------------- */
 void ONScripterLabel::deleteColorChanges()
 {
@@ -1775,7 +1955,7 @@ void ONScripterLabel::shadowTextDisplay( SDL_Surface *surface, SDL_Rect &clip )
         if ( rect.x + rect.w > surface->w ) rect.w = surface->w - rect.x;
         if ( rect.y + rect.h > surface->h ) rect.h = surface->h - rect.y;
 
-        SDL_LockSurface( surface );
+        AnimationInfo::lockSurface( surface );
         ONSBuf *buf = (ONSBuf *)surface->pixels + rect.y * surface->w + rect.x;
 
         SDL_PixelFormat *fmt = surface->format;
@@ -1793,7 +1973,7 @@ void ONScripterLabel::shadowTextDisplay( SDL_Surface *surface, SDL_Rect &clip )
             buf += surface->w - rect.w;
         }
 
-        SDL_UnlockSurface( surface );
+        AnimationInfo::unlockSurface( surface );
     }
     else if ( sentence_font_info.image_surface ){
         drawTaggedSurface( surface, &sentence_font_info, clip );
@@ -2025,6 +2205,12 @@ void ONScripterLabel::quit()
 {
     saveAll();
 
+    if ( debug_level > 0 ){
+        image_cache.dumpStats( stdout );
+        glyph_cache.dumpStats( stdout );
+        sound_cache.dumpStats( stdout );
+    }
+
     if ( cdrom_info ){
         SDL_CDStop( cdrom_info );
         SDL_CDClose( cdrom_info );
@@ -36,6 +36,14 @@
 #include "DirPaths.h"
 #include "ScriptParser.h"
 #include "DirtyRect.h"
+#include "ImagePrefetcher.h"
+#include "ImageCache.h"
+#include "BandRenderer.h"
+#include "SpriteIndex.h"
+#include "GlyphCache.h"
+#include "SoundCache.h"
+#include "Resampler.h"
+#include "AudioGain.h"
 #include <SDL.h>
 #include <SDL_image.h>
 #include <SDL_ttf.h>
@@ -60,6 +68,7 @@
 #define DEFAULT_VOLUME 100
 #define ONS_MIX_CHANNELS 50
 #define ONS_MIX_EXTRA_CHANNELS 5
+#define MIX_VOICE_CHANNEL 0
 #define MIX_WAVE_CHANNEL (ONS_MIX_CHANNELS+0)
 #define MIX_CLICKVOICE_CHANNEL (ONS_MIX_CHANNELS+1)
 #define MIX_BGM_CHANNEL (ONS_MIX_CHANNELS+2)
@@ -69,7 +78,10 @@
 #define DEFAULT_WM_TITLE "ONScripter"
 #define DEFAULT_WM_ICON  "ONScripter"
 
-#define NUM_GLYPH_CACHE 30
+
+#define DEFAULT_PREFETCH_THREADS 2
+#define PREFETCH_LOOKAHEAD 4096 // bytes of script scanned for image names
+#define TEXT_FLUSH_INTERVAL 16 // ms between screen updates of the text output
 
 class ONScripterLabel : public ScriptParser
 {
@@ -98,6 +110,12 @@ public:
     void setScaled();
 #endif
     void setMaskType( int mask_type ) { png_mask_type = mask_type; }
+    void setPrefetchThreads( int num ) { prefetch_threads = num; }
+    void setImageCacheSize( int mb ) { image_cache.setBudget( mb > 0 ? mb*1024*1024 : 0 ); }
+    void setGlyphCacheSize( int kb ) { glyph_cache.setBudget( kb > 0 ? kb*1024 : 0 ); }
+    void setSoundCacheSize( int mb ) { sound_cache.setBudget( mb > 0 ? mb*1024*1024 : 0 ); }
+    void setPreloadGlyphs() { preload_glyphs_flag = true; }
+    void setCompositorThreads( int num ) { compositor_threads = num; }
     void setEnglishMode()
 	{ script_h.default_script = ScriptHandler::LATIN_SCRIPT; }
 
@@ -107,6 +125,15 @@ public:
     void reset(); // used if definereset
     void resetSub(); // used if reset
 
+    // draws everything above the background inside clip, starting
+    // from the occluding sprite if there is one; may be called on
+    // several bands of a rect at once (see refreshSurface)
+    void refreshSurfaceBand( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int occluder=-1 );
+    // draws the rows of band for a frame of effectWhirl
+    void effectWhirlBand( SDL_Rect &band, int *theta_table );
+    // draws the rows of band for a frame of effectBreakup
+    void effectBreakupBand( SDL_Rect &band, SDL_Surface *chr, int x_dir, int y_dir );
+
     /* ---------------------------------------- */
     /* Commands */
     int wavestopCommand();
@@ -441,6 +468,14 @@ private:
     unsigned long mean_size_of_loaded_images;
     unsigned long num_loaded_images;
 
+    ImagePrefetcher image_prefetcher;
+    ImageCache image_cache;
+    int prefetch_threads;
+    char *prefetch_scan_start, *prefetch_scan_end;
+
+    BandRenderer band_renderer;
+    int compositor_threads;
+
     /* ---------------------------------------- */
     /* Button related variables */
     AnimationInfo btndef_info;
@@ -602,6 +637,8 @@ private:
     /* Sprite related variables */
     AnimationInfo *sprite_info;
     AnimationInfo *sprite2_info;
+    SpriteIndex sprite_index; // sprites with an image, see SpriteIndex.h
+    SpriteIndex sprite2_index;
     bool all_sprite_hide_flag;
     bool all_sprite2_hide_flag;
 
@@ -637,12 +674,8 @@ private:
     int  indent_offset;
     int  line_enter_status; // 0 ... no enter, 1 ... pretext, 2 ... body
     int  page_enter_status; // 0 ... no enter, 1 ... body
-    struct GlyphCache{
-        GlyphCache *next;
-        Uint16 text;
-        TTF_Font *font;
-        SDL_Surface *surface;
-    } *root_glyph_cache, glyph_cache[NUM_GLYPH_CACHE];
+    GlyphCache glyph_cache;
+    bool preload_glyphs_flag;
 
     //Mion: use the following for tracking text color changes in current page
     struct ColorChange{
@@ -667,7 +700,7 @@ private:
     int  refreshMode();
     void setwindowCore();
 
-    SDL_Surface *renderGlyph(TTF_Font *font, Uint16 text);
+    void preloadGlyphs();
     void drawGlyph( SDL_Surface *dst_surface, Fontinfo *info, SDL_Color &color, char *text, int xy[2], bool shadow_flag, AnimationInfo *cache_info, SDL_Rect *clip, SDL_Rect &dst_rect );
     void drawChar( char* text, Fontinfo *info, bool flush_flag, bool lookback_flag, SDL_Surface *surface, AnimationInfo *cache_info, SDL_Rect *clip=NULL );
     void drawString( const char *str, uchar3 color, Fontinfo *info, bool flush_flag, SDL_Surface *surface, SDL_Rect *rect = NULL, AnimationInfo *cache_info=NULL, bool skip_whitespace_flag=true );
@@ -718,7 +751,7 @@ private:
 
 #define ONS_TRIG_TABLE_SIZE 256
     float *sin_table, *cos_table;
-    int *whirl_table;
+    unsigned char *whirl_table; // already reduced modulo ONS_TRIG_TABLE_SIZE
 
     void buildSinTable();
     void buildCosTable();
@@ -741,7 +774,8 @@ private:
             dir = state = radius = 0;
         };
     } *breakup_cells;
-    bool *breakup_cellforms, *breakup_mask;
+    int *breakup_cellforms; // first and last+1 column of each row of each cellform
+    short *breakup_mask; // runs of pixels to update (> 0) or to leave (< 0)
     void buildBreakupCellforms();
     void buildBreakupMask();
     void initBreakup( char *params );
@@ -787,6 +821,7 @@ private:
     bool cdaudio_on_flag; // false if mute
     bool volume_on_flag; // false if mute
     SDL_AudioSpec audio_format;
+    SoundCache sound_cache;
     bool audio_open_flag;
 
     bool wave_play_loop_flag;
@@ -805,6 +840,7 @@ private:
     unsigned char *music_buffer; // for looped music
     long music_buffer_length;
     SMPEG *mp3_sample;
+    Resampler music_resampler; // for SMPEG and Ogg Vorbis music
     Uint32 mp3fade_start;
     Uint32 mp3fadeout_duration;
     Uint32 mp3fadein_duration;
@@ -821,7 +857,12 @@ private:
     void playCDAudio();
     int playWave(Mix_Chunk *chunk, int format, bool loop_flag, int channel);
     int playMP3();
-    int playOGG(int format, unsigned char *buffer, long length, bool loop_flag, int channel);
+    void hookSMPEG( SMPEG *mpeg, int freq );
+    int playOGG(int format, unsigned char *buffer, long length, bool loop_flag, int channel, const char *filename);
+    Mix_Chunk *decodeOGGChunk(OVInfo *ovi, int channels, int rate, int channel);
+    int streamOGG(OVInfo *ovi, unsigned char *buffer, int format, bool loop_flag, int channel);
+    static void streamOGGEffect(int chan, void *stream, int len, void *udata);
+    static void streamOGGDone(int chan, void *udata);
     int playExternalMusic(bool loop_flag);
     int playMIDI(bool loop_flag);
     // Mion: for music status and fades
@@ -836,8 +877,8 @@ private:
     void stopAllDWAVE();
     void playClickVoice();
     void setupWaveHeader( unsigned char *buffer, int channels, int rate, int bits, unsigned long data_length );
-    OVInfo *openOggVorbis(unsigned char *buf, long len, int &channels, int &rate);
-    int  closeOggVorbis(OVInfo *ovi);
+    OVInfo *openOggVorbis(const unsigned char *buf, long len, int &channels, int &rate);
+    static int closeOggVorbis(OVInfo *ovi);
 
     /* ---------------------------------------- */
     /* Movie related variables */
@@ -854,6 +895,9 @@ private:
     /* ---------------------------------------- */
     /* Text event related variables */
     TTF_Font *text_font;
+    SDL_Rect text_flush_rect; // characters drawn but not on the screen yet
+    bool text_flush_pending;
+    Uint32 text_flush_time;
     bool new_line_skip_flag;
     int text_speed_no;
 
@@ -863,8 +907,11 @@ private:
 
     void flush( int refresh_mode, SDL_Rect *rect=NULL, bool clear_dirty_flag=true, bool direct_flag=false );
     void flushDirect( SDL_Rect &rect, int refresh_mode, bool updaterect=true );
+    void flushText();
     void executeLabel();
     SDL_Surface *loadImage( char *file_name, bool *has_alpha=NULL );
+    SDL_Surface *decodeImage( char *file_name, bool *has_alpha, int *location );
+    void prefetchImages();
     int parseLine();
 
     void mouseOverCheck( int x, int y );
@@ -895,6 +942,8 @@ private:
     /* Image processing */
     unsigned char *resize_buffer;
     size_t resize_buffer_size;
+    unsigned char *mask_row_buffer; // a row of the mask in alphaBlend()
+    size_t mask_row_buffer_size;
 
     int  resizeSurface( SDL_Surface *src, SDL_Surface *dst );
     void shiftCursorOnButton( int diff );
@@ -907,6 +956,8 @@ private:
     void makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip );
     void makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &clip );
     void refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int refresh_mode = REFRESH_NORMAL_MODE );
+    bool isLayerVisible();
+    int findOccludingSprite( SDL_Rect &clip, int refresh_mode );
     void createBackground();
 
     /* ---------------------------------------- */
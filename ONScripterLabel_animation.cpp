@@ -25,7 +25,7 @@
 
 int ONScripterLabel::proceedAnimation()
 {
-    int i, minimum_duration = -1;
+    int i, k, minimum_duration = -1;
     AnimationInfo *anim;
     
     for ( i=0 ; i<3 ; i++ ){
@@ -35,15 +35,15 @@ int ONScripterLabel::proceedAnimation()
         }
     }
 
-    for ( i=MAX_SPRITE_NUM-1 ; i>=0 ; i-- ){
-        anim = &sprite_info[i];
+    for ( k=sprite_index.size()-1 ; k>=0 ; k-- ){
+        anim = &sprite_info[ sprite_index[k] ];
         if ( anim->visible && anim->is_animatable ){
             minimum_duration = estimateNextDuration( anim, anim->pos, minimum_duration );
         }
     }
     //Mion - ogapee2008
-    for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
-        anim = &sprite2_info[i];
+    for ( k=sprite2_index.size()-1 ; k>=0 ; k-- ){
+        anim = &sprite2_info[ sprite2_index[k] ];
         if ( anim->visible && anim->is_animatable ){
             minimum_duration = estimateNextDuration( anim, anim->pos, minimum_duration );
         }
@@ -124,7 +124,7 @@ int ONScripterLabel::estimateNextDuration( AnimationInfo *anim, SDL_Rect &rect,
 
 void ONScripterLabel::resetRemainingTime( int t )
 {
-    int i;
+    int i, k;
     AnimationInfo *anim;
     
     for ( i=0 ; i<3 ; i++ ){
@@ -136,8 +136,8 @@ void ONScripterLabel::resetRemainingTime( int t )
         }
     }
         
-    for ( i=MAX_SPRITE_NUM-1 ; i>=0 ; i-- ){
-        anim = &sprite_info[i];
+    for ( k=sprite_index.size()-1 ; k>=0 ; k-- ){
+        anim = &sprite_info[ sprite_index[k] ];
         if ( anim->visible && anim->is_animatable ){
             anim->remaining_time -= t;
             if (anim->remaining_time < 0)
@@ -145,8 +145,8 @@ void ONScripterLabel::resetRemainingTime( int t )
         }
     }
     //Mion - ogapee2008
-    for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
-        anim = &sprite2_info[i];
+    for ( k=sprite2_index.size()-1 ; k>=0 ; k-- ){
+        anim = &sprite2_info[ sprite2_index[k] ];
         if ( anim->visible && anim->is_animatable ){
             anim->remaining_time -= t;
             if (anim->remaining_time < 0)
@@ -236,6 +236,15 @@ void ONScripterLabel::setupAnimationInfo( AnimationInfo *anim, Fontinfo *info )
         }
     }
     else if (anim->trans_mode != AnimationInfo::TRANS_LAYER) {
+        if ( image_cache.restore( anim, screen_ratio1, screen_ratio2, png_mask_type ) ){
+            if ( filelog_flag ){
+                script_h.findAndAddLog( script_h.log_info[ScriptHandler::FILE_LOG], anim->file_name, true );
+                if (anim->trans_mode == AnimationInfo::TRANS_MASK && anim->mask_file_name)
+                    script_h.findAndAddLog( script_h.log_info[ScriptHandler::FILE_LOG], anim->mask_file_name, true );
+            }
+            return;
+        }
+
 	bool has_alpha;
         SDL_Surface *surface = loadImage( anim->file_name, &has_alpha );
 
@@ -244,6 +253,8 @@ void ONScripterLabel::setupAnimationInfo( AnimationInfo *anim, Fontinfo *info )
             surface_m = loadImage( anim->mask_file_name );
         
         anim->setupImage(surface, surface_m, has_alpha);
+        if ( surface && (anim->trans_mode != AnimationInfo::TRANS_MASK || surface_m) )
+            image_cache.store( anim, screen_ratio1, screen_ratio2, png_mask_type );
 
         if ( surface ) SDL_FreeSurface(surface);
         if ( surface_m ) SDL_FreeSurface(surface_m);
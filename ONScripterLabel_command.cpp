@@ -1156,6 +1156,10 @@ int ONScripterLabel::savescreenshotCommand()
 	    filename[last_delim] = DELIMITER;
 	}
         SDL_SaveBMP( screenshot_surface, filename );
+        // the new file may be loaded as an image later on
+        script_h.cBR->resetFileListing();
+        image_cache.remove( buf );
+        image_prefetcher.remove( buf );
     }
     else
         printf("savescreenshot: file %s is not supported.\n", buf );
@@ -1798,19 +1802,20 @@ int ONScripterLabel::lsp2Command()
     sprite2_info[ no ].calcAffineMatrix();
 
 #ifdef RCA_SCALE
-    if (sprite_info2[ no ].image_surface 
+    if (sprite2_info[ no ].image_surface 
         && ( scr_stretch_y > 1.0 || scr_stretch_x > 1.0 )) {
-        SDL_Surface* src = sprite_info2[ no ].image_surface;
+        SDL_Surface* src = sprite2_info[ no ].image_surface;
         SDL_PixelFormat *fmt = src->format;
         SDL_Surface* dst = SDL_CreateRGBSurface( SDL_SWSURFACE, 
                                                  scr_stretch_x*src->w,
                                                  scr_stretch_y*src->h,
                                                  fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask );
         resizeSurface( src, dst );
-        sprite_info2[ no ].image_surface = dst;
-        sprite_info2[ no ].pos.w *= scr_stretch_x;
-        sprite_info2[ no ].pos.h *= scr_stretch_y;
+        sprite2_info[ no ].image_surface = dst;
+        sprite2_info[ no ].pos.w *= scr_stretch_x;
+        sprite2_info[ no ].pos.h *= scr_stretch_y;
         SDL_FreeSurface( src );
+        sprite2_info[ no ].calcOpaqueRect();
 
     }
 #endif
@@ -1868,6 +1873,7 @@ int ONScripterLabel::lspCommand()
         sprite_info[ no ].pos.w *= scr_stretch_x;
         sprite_info[ no ].pos.h *= scr_stretch_y;
         SDL_FreeSurface( src );
+        sprite_info[ no ].calcOpaqueRect();
 
     }
 #endif
@@ -2800,6 +2806,10 @@ int ONScripterLabel::gameCommand()
         setupAnimationInfo( &lookback_info[3] );
     }
 
+    /* ---------------------------------------- */
+    /* Render the characters of the script ahead of the first page */
+    if ( preload_glyphs_flag ) preloadGlyphs();
+
     /* ---------------------------------------- */
     /* Load default cursor */
     loadCursor( CURSOR_WAIT_NO, DEFAULT_CURSOR_WAIT, 0, 0 );
@@ -4016,9 +4026,9 @@ int ONScripterLabel::amspCommand()
 int ONScripterLabel::allsp2resumeCommand()
 {
     all_sprite2_hide_flag = false;
-    for ( int i=0 ; i<MAX_SPRITE2_NUM ; i++ ){
-        if ( sprite2_info[i].visible )
-            dirty_rect.add( sprite2_info[i].bounding_rect );
+    for ( int k=0 ; k<sprite2_index.size() ; k++ ){
+        if ( sprite2_info[ sprite2_index[k] ].visible )
+            dirty_rect.add( sprite2_info[ sprite2_index[k] ].bounding_rect );
     }
     return RET_CONTINUE;
 }
@@ -4026,9 +4036,9 @@ int ONScripterLabel::allsp2resumeCommand()
 int ONScripterLabel::allspresumeCommand()
 {
     all_sprite_hide_flag = false;
-    for ( int i=0 ; i<MAX_SPRITE_NUM ; i++ ){
-        if ( sprite_info[i].visible )
-            dirty_rect.add( sprite_info[i].pos );
+    for ( int k=0 ; k<sprite_index.size() ; k++ ){
+        if ( sprite_info[ sprite_index[k] ].visible )
+            dirty_rect.add( sprite_info[ sprite_index[k] ].pos );
     }
     return RET_CONTINUE;
 }
@@ -4036,9 +4046,9 @@ int ONScripterLabel::allspresumeCommand()
 int ONScripterLabel::allsp2hideCommand()
 {
     all_sprite2_hide_flag = true;
-    for ( int i=0 ; i<MAX_SPRITE2_NUM ; i++ ){
-        if ( sprite2_info[i].visible )
-            dirty_rect.add( sprite2_info[i].bounding_rect );
+    for ( int k=0 ; k<sprite2_index.size() ; k++ ){
+        if ( sprite2_info[ sprite2_index[k] ].visible )
+            dirty_rect.add( sprite2_info[ sprite2_index[k] ].bounding_rect );
     }
     return RET_CONTINUE;
 }
@@ -4046,9 +4056,9 @@ int ONScripterLabel::allsp2hideCommand()
 int ONScripterLabel::allsphideCommand()
 {
     all_sprite_hide_flag = true;
-    for ( int i=0 ; i<MAX_SPRITE_NUM ; i++ ){
-        if ( sprite_info[i].visible )
-            dirty_rect.add( sprite_info[i].pos );
+    for ( int k=0 ; k<sprite_index.size() ; k++ ){
+        if ( sprite_info[ sprite_index[k] ].visible )
+            dirty_rect.add( sprite_info[ sprite_index[k] ].pos );
     }
     return RET_CONTINUE;
 }
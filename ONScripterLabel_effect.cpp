@@ -677,19 +677,30 @@ void ONScripterLabel::buildWhirlTable()
 {
     if (whirl_table) return;
 
-    whirl_table = new int[screen_height * screen_width];
-    int *dst_buffer = whirl_table;
+    whirl_table = new unsigned char[screen_height * screen_width];
+    unsigned char *dst_buffer = whirl_table;
 
     for ( int i=0 ; i<screen_height ; ++i ){
         for ( int j=0; j<screen_width ; ++j, ++dst_buffer ){
             int x = j - CENTER_X, y = i - CENTER_Y;
             // actual x = x + 0.5, actual y = y + 0.5;
             // (x+0.5)^2 + (y+0.5)^2 = x^2 + x + 0.25 + y^2 + y + 0.25
-            *dst_buffer = (int)(sqrt((float)(x * x + x + y * y + y) + 0.5) * 4);
+            *dst_buffer = (int)(sqrt((float)(x * x + x + y * y + y) + 0.5) * 4) % ONS_TRIG_TABLE_SIZE;
         }
     }            
 }
 
+struct WhirlBandInfo{
+    ONScripterLabel *ons;
+    int *theta_table;
+};
+
+static void whirlBand( void *data, SDL_Rect &band )
+{
+    WhirlBandInfo *info = (WhirlBandInfo*)data;
+    info->ons->effectWhirlBand( band, info->theta_table );
+}
+
 void ONScripterLabel::effectWhirl( char *params, int duration )
 {
 #define OMEGA (ONS_TRIG_TABLE_SIZE / 128)
@@ -706,36 +717,56 @@ void ONScripterLabel::effectWhirl( char *params, int duration )
     //float rad_amp = M_PI * (sin(t) - one_minus_cos);
     //float rad_base = M_PI * 2 * one_minus_cos + rad_amp;
 
+    // the rotation only depends on the whirl factor of a pixel,
+    // which takes ONS_TRIG_TABLE_SIZE values
+    int theta_table[ONS_TRIG_TABLE_SIZE];
+    for ( int i=0 ; i<ONS_TRIG_TABLE_SIZE ; i++ ){
+        int theta = direction * (int)(rad_base + rad_amp * sin_table[i]);
+        //float theta = direction * (rad_base + rad_amp * 
+        //                           sin(sqrt(x * x + y * y) * OMEGA));
+        while (theta < 0) theta += ONS_TRIG_TABLE_SIZE;
+        theta_table[i] = theta % ONS_TRIG_TABLE_SIZE;
+    }
+
     int width = 256 * effect_counter / duration;
     alphaBlend( NULL, ALPHA_BLEND_CONST, width, &dirty_rect.bounding_box,
                 NULL, NULL, effect_tmp_surface );
 
     SDL_LockSurface( effect_tmp_surface );
     SDL_LockSurface( accumulation_surface );
+
+    // every row only reads effect_tmp_surface and writes its own
+    // pixels of accumulation_surface
+    SDL_Rect rect = {0, 0, screen_width, screen_height};
+    if ( band_renderer.isActive() ){
+        WhirlBandInfo info = {this, theta_table};
+        band_renderer.render( rect, whirlBand, &info );
+    }
+    else{
+        effectWhirlBand( rect, theta_table );
+    }
+
+    SDL_UnlockSurface( accumulation_surface );
+    SDL_UnlockSurface( effect_tmp_surface );
+}
+
+void ONScripterLabel::effectWhirlBand( SDL_Rect &band, int *theta_table )
+{
     ONSBuf *src_buffer = (ONSBuf *)effect_tmp_surface->pixels;
-    ONSBuf *dst_buffer = (ONSBuf *)accumulation_surface->pixels;
-    int *whirl_buffer = whirl_table;
+    ONSBuf *dst_buffer = (ONSBuf *)accumulation_surface->pixels + screen_width * band.y;
+    unsigned char *whirl_buffer = whirl_table + screen_width * band.y;
 
-    for ( int i=0 ; i<screen_height ; ++i ){
+    for ( int i=band.y ; i<band.y+band.h ; ++i ){
+        // actual y = y + 0.5
+        float fy = (float)(i - CENTER_Y + 0.5);
         for ( int j=0 ; j<screen_width ; ++j, ++dst_buffer, ++whirl_buffer ){
-            int ii=i, jj=j;
-            // actual x = x + 0.5, actual y = y + 0.5
-            int x = j - CENTER_X, y = i - CENTER_Y;
-            //whirl factor
-            int theta = *whirl_buffer;
-            while (theta < 0) theta += ONS_TRIG_TABLE_SIZE;
-            theta %= ONS_TRIG_TABLE_SIZE;
-            theta = direction * (int)(rad_base + rad_amp * sin_table[theta]);
-            //float theta = direction * (rad_base + rad_amp * 
-            //                           sin(sqrt(x * x + y * y) * OMEGA));
+            // actual x = x + 0.5
+            float fx = (float)(j - CENTER_X + 0.5);
+            int theta = theta_table[*whirl_buffer];
 
             //perform rotation
-            while (theta < 0) theta += ONS_TRIG_TABLE_SIZE;
-            theta %= ONS_TRIG_TABLE_SIZE;
-            jj = (int) ((float)(x + 0.5) * cos_table[theta] -
-                        (float)(y + 0.5) * sin_table[theta] + CENTER_X - 0.5);
-            ii = (int) ((float)(x + 0.5) * sin_table[theta] + 
-                        (float)(y + 0.5) * cos_table[theta] + CENTER_Y - 0.5);
+            int jj = (int) (fx * cos_table[theta] - fy * sin_table[theta] + CENTER_X - 0.5);
+            int ii = (int) (fx * sin_table[theta] + fy * cos_table[theta] + CENTER_Y - 0.5);
             //jj = (int) (x * cos_theta - y * sin_theta + CENTER_X);
             //ii = (int) (x * sin_theta + y * cos_theta + CENTER_Y);
             if (jj < 0) jj = 0;
@@ -747,9 +778,6 @@ void ONScripterLabel::effectWhirl( char *params, int duration )
             *dst_buffer = *(src_buffer + screen_width * ii + jj);
         }
     }
-
-    SDL_UnlockSurface( accumulation_surface );
-    SDL_UnlockSurface( effect_tmp_surface );
 }
 
 #define BREAKUP_CELLWIDTH 24
@@ -774,20 +802,21 @@ SDL_Rect breakup_window;  // window of _cells_, not pixels
 
 void ONScripterLabel::buildBreakupCellforms()
 {
-// build the 32x32 mask for each cellform
+// build the mask for each cellform; each is a disc, so every row of
+// it is a single span of columns
     if (breakup_cellforms) return;
 
-    int w = BREAKUP_CELLWIDTH * BREAKUP_CELLFORMS;
-    int h = BREAKUP_CELLWIDTH;
-    breakup_cellforms = new bool[w*h];
+    breakup_cellforms = new int[BREAKUP_CELLFORMS * BREAKUP_CELLWIDTH * 2];
 
     for (int n=0, rad2=1; n<BREAKUP_CELLFORMS; n++, rad2=(n+1)*(n+1)) {
-        for (int x=0, xd=-BREAKUP_CELLWIDTH/2; x<BREAKUP_CELLWIDTH; x++, xd++) {
-            for (int y=0, yd=-BREAKUP_CELLWIDTH/2; y<BREAKUP_CELLWIDTH; y++, yd++) {
-                if (((xd * xd + xd + yd * yd + yd)*2 + 1) < 2*rad2)
-                    breakup_cellforms[y*w + n*BREAKUP_CELLWIDTH + x] = true;
-                else
-                    breakup_cellforms[y*w + n*BREAKUP_CELLWIDTH + x] = false;
+        for (int y=0, yd=-BREAKUP_CELLWIDTH/2; y<BREAKUP_CELLWIDTH; y++, yd++) {
+            int *span = &breakup_cellforms[(n*BREAKUP_CELLWIDTH + y)*2];
+            span[0] = span[1] = 0;
+            for (int x=0, xd=-BREAKUP_CELLWIDTH/2; x<BREAKUP_CELLWIDTH; x++, xd++) {
+                if (((xd * xd + xd + yd * yd + yd)*2 + 1) < 2*rad2) {
+                    if (span[0] == span[1]) span[0] = x;
+                    span[1] = x + 1;
+                }
             }
         }
     }
@@ -799,7 +828,7 @@ void ONScripterLabel::buildBreakupMask()
     int w = BREAKUP_CELLWIDTH * BREAKUP_MAX_CELL_X;
     int h = BREAKUP_CELLWIDTH * BREAKUP_MAX_CELL_Y;
     if (! breakup_mask) {
-        breakup_mask = new bool[w*h];
+        breakup_mask = new short[w*h];
     }
 
     SDL_LockSurface( effect_src_surface );
@@ -813,14 +842,14 @@ void ONScripterLabel::buildBreakupMask()
     for (int i=0; i<h; ++i) {
         for (int j=0; j<w; ++j) {
             if ((j >= surf_w) || (i >= surf_h)) {
-                breakup_mask[i*w+j] = false;
+                breakup_mask[i*w+j] = 0;
                 continue;
             }
             ONSBuf pix1 = buffer1[i*surf_w+j];
             ONSBuf pix2 = buffer2[i*surf_w+j];
             int pix1c = (pix1 & 0x000000ff);
             int pix2c = (pix2 & 0x000000ff);
-            breakup_mask[i*w+j] = true;
+            breakup_mask[i*w+j] = 1;
             if (abs(pix1c - pix2c) > 8) {
                 if (y1 < 0) y1 = i;
                 if (j < x1) x1 = j;
@@ -855,7 +884,7 @@ void ONScripterLabel::buildBreakupMask()
                 y2 = i;
                 continue;
             }
-            breakup_mask[i*w+j] = false;
+            breakup_mask[i*w+j] = 0;
         }
     }
     if (breakup_mode & BREAKUP_MODE_LEFT)
@@ -871,6 +900,19 @@ void ONScripterLabel::buildBreakupMask()
     breakup_window.w = x2/BREAKUP_CELLWIDTH - breakup_window.x + 1;
     breakup_window.h = y2/BREAKUP_CELLWIDTH - breakup_window.y + 1;
 
+    // turn the mask into runs, counted to the end of each row
+    for (int i=0; i<h; ++i) {
+        short *row = &breakup_mask[i*w];
+        int run = 0;
+        for (int j=w-1; j>=0; --j) {
+            if (row[j] > 0)
+                run = (run > 0) ? run + 1 : 1;
+            else
+                run = (run < 0) ? run - 1 : -1;
+            row[j] = run;
+        }
+    }
+
     SDL_UnlockSurface( effect_dst_surface );
     SDL_UnlockSurface( effect_src_surface );
 }
@@ -940,6 +982,18 @@ void ONScripterLabel::initBreakup( char *params )
     }
 }
 
+struct BreakupBandInfo{
+    ONScripterLabel *ons;
+    SDL_Surface *chr;
+    int x_dir, y_dir;
+};
+
+static void breakupBand( void *data, SDL_Rect &band )
+{
+    BreakupBandInfo *info = (BreakupBandInfo*)data;
+    info->ons->effectBreakupBand( band, info->chr, info->x_dir, info->y_dir );
+}
+
 void ONScripterLabel::effectBreakup( char *params, int duration )
 {
     int x_dir = -1;
@@ -975,74 +1029,107 @@ void ONScripterLabel::effectBreakup( char *params, int duration )
         y_dir = -y_dir;
     }
 
+    for (int n=0; n<n_cells; ++n) {
+        breakup_cells[n].state += frame_diff;
+        int state = breakup_cells[n].state;
+        if (state >= (BREAKUP_MOVE_FRAMES + BREAKUP_STILL_STATE))
+            continue;
+        if (state >= BREAKUP_MOVE_FRAMES)
+            breakup_cells[n].radius = state - (BREAKUP_MOVE_FRAMES*3/4) + 1;
+        else if (state >= 0) {
+            breakup_cells[n].radius = 0;
+            if (state >= (BREAKUP_MOVE_FRAMES/2))
+                breakup_cells[n].radius = (state/2) - (BREAKUP_MOVE_FRAMES/4) + 1;
+        }
+    }
+
     SDL_LockSurface( chr );
     SDL_LockSurface( dst );
+
+    // cells are drawn in order and may overlap once they move, so
+    // the work is split by rows of the screen rather than by cells
+    SDL_Rect rect = {0, 0, dst->w, dst->h};
+    if ( band_renderer.isActive() ){
+        BreakupBandInfo info = {this, chr, x_dir, y_dir};
+        band_renderer.render( rect, breakupBand, &info );
+    }
+    else{
+        effectBreakupBand( rect, chr, x_dir, y_dir );
+    }
+
+    SDL_UnlockSurface( accumulation_surface );
+    SDL_UnlockSurface( chr );
+}
+
+// Copy the pixels of a cell row that the mask marks as changed.
+// mask points at the run of the first pixel; runs are counted to
+// the end of the row, so they may reach past len.
+static void copyBreakupSpan( ONScripterLabel::ONSBuf *dst, ONScripterLabel::ONSBuf *src,
+                             short *mask, int len )
+{
+    int j = 0;
+    while (j < len) {
+        int run = mask[j];
+        if (run > 0) {
+            if (run > len - j) run = len - j;
+            memcpy( dst + j, src + j, run * sizeof(ONScripterLabel::ONSBuf) );
+            j += run;
+        }
+        else
+            j -= run;
+    }
+}
+
+void ONScripterLabel::effectBreakupBand( SDL_Rect &band, SDL_Surface *chr, int x_dir, int y_dir )
+{
+    SDL_Surface *dst = accumulation_surface;
     ONSBuf *chr_buf = (ONSBuf *)chr->pixels;
     ONSBuf *buffer  = (ONSBuf *)dst->pixels;
-    bool *msk_buf = breakup_cellforms;
+    int mask_w = BREAKUP_CELLWIDTH * BREAKUP_MAX_CELL_X;
 
     for (int n=0; n<n_cells; ++n) {
-        SDL_Rect rect = { breakup_cells[n].cell_x * BREAKUP_CELLWIDTH,
-                          breakup_cells[n].cell_y * BREAKUP_CELLWIDTH, 
-                          BREAKUP_CELLWIDTH, BREAKUP_CELLWIDTH };
-        breakup_cells[n].state += frame_diff;
-        if (breakup_cells[n].state >= (BREAKUP_MOVE_FRAMES + BREAKUP_STILL_STATE)) {
-            for (int i=0; i<BREAKUP_CELLWIDTH; ++i) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; ++j) {
-                    int x = rect.x + j;
-                    int y = rect.y + i;
-                    if ((x < 0) || (x >= dst->w) || (x >= chr->w) ||
-                        (y < 0) || (y >= dst->h) || (y >= chr->h))
-                        continue;
-                    if ( breakup_mask[y*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + x] )
-                        buffer[y*dst->w + x] = chr_buf[y*chr->w + x];
-                }
-            }
-        }
-        else if (breakup_cells[n].state >= BREAKUP_MOVE_FRAMES) {
-            breakup_cells[n].radius = breakup_cells[n].state - (BREAKUP_MOVE_FRAMES*3/4) + 1;
-            for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; j++) {
-                    int x = rect.x + j;
-                    int y = rect.y + i;
-                    if ((x < 0) || (x >= dst->w) || (x >= chr->w) ||
-                        (y < 0) || (y >= dst->h) || (y >= chr->h))
-                        continue;
-                    int msk_off = BREAKUP_CELLWIDTH*breakup_cells[n].radius;
-                    if ( msk_buf[BREAKUP_CELLWIDTH * BREAKUP_CELLFORMS * i + msk_off + j] &&
-                         breakup_mask[y*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + x] )
-                        buffer[y*dst->w + x] = chr_buf[y*chr->w + x];
-                }
-            }
+        int state = breakup_cells[n].state;
+        if (state < 0) continue;
+
+        // the cell is read at (src_x, src_y) and drawn displaced by
+        // (disp_x, disp_y), one span of columns per row
+        int src_x = breakup_cells[n].cell_x * BREAKUP_CELLWIDTH;
+        int src_y = breakup_cells[n].cell_y * BREAKUP_CELLWIDTH;
+        int disp_x = 0, disp_y = 0;
+        int *spans = NULL;
+        if (state < (BREAKUP_MOVE_FRAMES + BREAKUP_STILL_STATE))
+            spans = &breakup_cellforms[breakup_cells[n].radius * BREAKUP_CELLWIDTH * 2];
+        if (state < BREAKUP_MOVE_FRAMES) {
+            disp_x = x_dir * breakup_disp_x[breakup_cells[n].dir] * (state-BREAKUP_MOVE_FRAMES);
+            disp_y = y_dir * breakup_disp_y[breakup_cells[n].dir] * (BREAKUP_MOVE_FRAMES-state);
         }
-        else if (breakup_cells[n].state >= 0) {
-            int state = breakup_cells[n].state;
-            int disp_x = x_dir * breakup_disp_x[breakup_cells[n].dir] * (state-BREAKUP_MOVE_FRAMES);
-            int disp_y = y_dir * breakup_disp_y[breakup_cells[n].dir] * (BREAKUP_MOVE_FRAMES-state);
 
-            breakup_cells[n].radius = 0;
-            if (breakup_cells[n].state >= (BREAKUP_MOVE_FRAMES/2))
-                breakup_cells[n].radius = (breakup_cells[n].state/2) - (BREAKUP_MOVE_FRAMES/4) + 1;
-            for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; j++) {
-                    int x = disp_x + rect.x + j;
-                    int y = disp_y + rect.y + i;
-                    if ((x < 0) || (x >= dst->w) ||
-                        (y < 0) || (y >= dst->h))
-                        continue;
-                    if (((rect.x+j)<0) || ((rect.x+j) >= chr->w) ||
-                        ((rect.y+i)<0) || ((rect.y+i) >= chr->h))
-                        continue;
-                    int msk_off = BREAKUP_CELLWIDTH*breakup_cells[n].radius;
-                    if ( msk_buf[BREAKUP_CELLWIDTH * BREAKUP_CELLFORMS * i + msk_off + j] &&
-                         breakup_mask[(rect.y+i)*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + rect.x + j] )
-                        buffer[y*dst->w + x] =
-                            chr_buf[(rect.y+i)*chr->w + rect.x + j];
-                }
+        // columns that are inside both surfaces
+        int j_min = 0, j_max = BREAKUP_CELLWIDTH;
+        if (j_min < -src_x) j_min = -src_x;
+        if (j_min < -src_x - disp_x) j_min = -src_x - disp_x;
+        if (j_max > chr->w - src_x) j_max = chr->w - src_x;
+        if (j_max > dst->w - src_x - disp_x) j_max = dst->w - src_x - disp_x;
+
+        for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
+            int y = src_y + i;
+            int dy = y + disp_y;
+            if ((y < 0) || (y >= chr->h) ||
+                (dy < 0) || (dy >= dst->h) ||
+                (dy < band.y) || (dy >= band.y + band.h))
+                continue;
+
+            int j0 = j_min, j1 = j_max;
+            if (spans) {
+                if (j0 < spans[i*2])   j0 = spans[i*2];
+                if (j1 > spans[i*2+1]) j1 = spans[i*2+1];
             }
+            if (j0 >= j1) continue;
+
+            int x = src_x + j0;
+            copyBreakupSpan( buffer + dy*dst->w + x + disp_x,
+                             chr_buf + y*chr->w + x,
+                             breakup_mask + y*mask_w + x, j1 - j0 );
         }
     }
-
-    SDL_UnlockSurface( accumulation_surface );
-    SDL_UnlockSurface( chr );
 }
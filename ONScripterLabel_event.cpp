@@ -43,6 +43,7 @@
 #define EDIT_SELECT_STRING "MP3 vol (m)  SE vol (s)  Voice vol (v)  Numeric variable (n)"
 
 static SDL_TimerID timer_id = NULL;
+static Uint32 timer_due = 0; // when timer_id fires
 SDL_TimerID timer_cdaudio_id = NULL;
 SDL_TimerID anim_timer_id = NULL;
 
@@ -59,7 +60,7 @@ SDL_TimerID timer_midi_id = NULL;
 #endif
 bool ext_music_play_once_flag = false;
 
-extern long decodeOggVorbis(ONScripterLabel::MusicStruct *music_strct, Uint8 *buf_dst, long len, bool do_rate_conversion);
+extern long decodeOggVorbis(ONScripterLabel::MusicStruct *music_strct, Uint8 *buf_dst, long len, bool mixer_flag);
 
 /* **************************************** *
  * Callback functions
@@ -82,6 +83,15 @@ extern "C" void oggcallback( void *userdata, Uint8 *stream, int len )
     }
 }
 
+extern "C" void resamplecallback( void *userdata, Uint8 *stream, int len )
+{
+    if (((Resampler*)userdata)->resample(stream, len) == 0){
+        SDL_Event event;
+        event.type = ONS_SOUND_EVENT;
+        SDL_PushEvent(&event);
+    }
+}
+
 extern "C" Uint32 SDLCALL animCallback( Uint32 interval, void *param )
 {
     SDL_RemoveTimer( anim_timer_id );
@@ -353,6 +363,7 @@ void ONScripterLabel::advancePhase( int count )
     }
 
     if (count > 0){
+        timer_due = SDL_GetTicks() + count;
         timer_id = SDL_AddTimer( count, timerCallback, NULL );
         if (timer_id != NULL) return;
     }
@@ -1169,7 +1180,20 @@ int ONScripterLabel::eventLoop()
 
     advancePhase();
 
-    while ( SDL_WaitEvent(&event) ) {
+    while ( 1 ){
+        // The characters drawn by the text output are put on the
+        // screen together once a frame.  Stay behind only while
+        // more events are queued or the timer will wake us up
+        // before the frame is due.
+        if ( text_flush_pending ){
+            Uint32 deadline = text_flush_time + TEXT_FLUSH_INTERVAL;
+            if ( (Sint32)(SDL_GetTicks() - deadline) >= 0 ||
+                 ( SDL_PeepEvents( &tmp_event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS ) == 0 &&
+                   ( timer_id == NULL || (Sint32)(timer_due - deadline) >= 0 ) ) )
+                flushText();
+        }
+        if ( !SDL_WaitEvent(&event) ) break;
+
         // ignore continous SDL_MOUSEMOTION
         while (event.type == SDL_MOUSEMOTION){
             if ( SDL_PeepEvents( &tmp_event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS ) == 0 ) break;
@@ -78,7 +78,10 @@ void ONScripterLabel::alphaBlend( SDL_Surface *mask_surface,
 {
     SDL_Rect rect = {0, 0, screen_width, screen_height};
     int i, j;
-    Uint32 mask, mask1, mask2, mask_rb;
+    Uint32 mask2;
+#ifdef BPP16
+    Uint32 mask, mask1, mask_rb;
+#endif
     ONSBuf *mask_buffer=NULL;
 
     if (src1 == NULL)
@@ -106,16 +109,43 @@ void ONScripterLabel::alphaBlend( SDL_Surface *mask_surface,
     ONSBuf *dst_buffer  = (ONSBuf *)dst->pixels + dst->w * rect.y + rect.x;
 
     SDL_PixelFormat *fmt = dst->format;
-    Uint32 overflow_mask;
-    if ( trans_mode == ALPHA_BLEND_FADE_MASK )
-        overflow_mask = 0xffffffff;
-    else
-        overflow_mask = ~fmt->Bmask;
-
     mask_value >>= fmt->Bloss;
     mask2 = mask_value & fmt->Bmask;
-    mask1 = mask2 ^ fmt->Bmask;
 
+#ifndef BPP16
+    if ( mask_surface && mask_row_buffer_size < (size_t)rect.w ){
+        if ( mask_row_buffer ) delete[] mask_row_buffer;
+        mask_row_buffer = new unsigned char[rect.w];
+        mask_row_buffer_size = rect.w;
+    }
+
+    int mask_row = -1;
+    for ( i=0; i<rect.h ; i++ ) {
+        if ( trans_mode == ALPHA_BLEND_FADE_MASK ||
+             trans_mode == ALPHA_BLEND_CROSSFADE_MASK ){
+            // tile the mask over the row once, instead of wrapping
+            // around the mask for each pixel
+            if ( mask_row != (rect.y+i)%mask_surface->h ){
+                mask_row = (rect.y+i)%mask_surface->h;
+                mask_buffer = (ONSBuf *)mask_surface->pixels + mask_surface->w * mask_row;
+                int k = rect.x % mask_surface->w;
+                for ( j=0 ; j<rect.w ; j++ ){
+                    mask_row_buffer[j] = mask_buffer[k] & fmt->Bmask;
+                    if ( ++k == mask_surface->w ) k = 0;
+                }
+            }
+            AnimationInfo::imageFilterCrossfadeMask( dst_buffer, src1_buffer, src2_buffer,
+                                                     mask_row_buffer, mask_value,
+                                                     trans_mode == ALPHA_BLEND_FADE_MASK, rect.w );
+        }
+        else{ // ALPHA_BLEND_CONST
+            AnimationInfo::imageFilterCrossfade( dst_buffer, src1_buffer, src2_buffer, mask2, rect.w );
+        }
+        src1_buffer += screen_width;
+        src2_buffer += screen_width;
+        dst_buffer  += screen_width;
+    }
+#else
     for ( i=0; i<rect.h ; i++ ) {
         if (mask_surface) mask_buffer = (ONSBuf *)mask_surface->pixels + mask_surface->w * ((rect.y+i)%mask_surface->h);
 
@@ -143,6 +173,7 @@ void ONScripterLabel::alphaBlend( SDL_Surface *mask_surface,
         src2_buffer += screen_width - rect.w;
         dst_buffer  += screen_width - rect.w;
     }
+#endif
     
     if ( mask_surface ) SDL_UnlockSurface( mask_surface );
     SDL_UnlockSurface( dst );
@@ -232,7 +263,7 @@ void ONScripterLabel::alphaBlend32( SDL_Surface *dst_surface, SDL_Rect dst_rect,
 
 void ONScripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
-    SDL_LockSurface( surface );
+    AnimationInfo::lockSurface( surface );
     ONSBuf *buf = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x;
 
     ONSBuf mask = surface->format->Rmask | surface->format->Gmask | surface->format->Bmask;
@@ -242,12 +273,12 @@ void ONScripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
         buf += surface->w - clip.w;
     }
 
-    SDL_UnlockSurface( surface );
+    AnimationInfo::unlockSurface( surface );
 }
 
 void ONScripterLabel::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
-    SDL_LockSurface( surface );
+    AnimationInfo::lockSurface( surface );
     ONSBuf *buf = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x, c;
 
     SDL_PixelFormat *fmt = surface->format;
@@ -263,7 +294,20 @@ void ONScripterLabel::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &cli
         buf += surface->w - clip.w;
     }
 
-    SDL_UnlockSurface( surface );
+    AnimationInfo::unlockSurface( surface );
+}
+
+struct RefreshBandInfo{
+    ONScripterLabel *ons;
+    SDL_Surface *surface;
+    int refresh_mode;
+    int occluder;
+};
+
+static void refreshBand( void *data, SDL_Rect &band )
+{
+    RefreshBandInfo *info = (RefreshBandInfo*)data;
+    info->ons->refreshSurfaceBand( info->surface, band, info->refresh_mode, info->occluder );
 }
 
 void ONScripterLabel::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int refresh_mode )
@@ -273,15 +317,94 @@ void ONScripterLabel::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src,
     SDL_Rect clip = {0, 0, surface->w, surface->h};
     if (clip_src) if ( AnimationInfo::doClipping( &clip, clip_src ) ) return;
 
-    int i, top;
-    SDL_BlitSurface( bg_info.image_surface, &clip, surface, &clip );
+    // a sprite that hides the whole clip makes the background and
+    // everything drawn before it redundant
+    int occluder = findOccludingSprite( clip, refresh_mode );
+    if ( occluder < 0 )
+        SDL_BlitSurface( bg_info.image_surface, &clip, surface, &clip );
+
+    // everything drawn on top of the background only touches the
+    // pixels inside the clip rect, so horizontal bands of it can be
+    // drawn in parallel, except for layers that keep their own state
+    if ( band_renderer.isActive() && !isLayerVisible() ){
+        RefreshBandInfo info = {this, surface, refresh_mode, occluder};
+        band_renderer.render( clip, refreshBand, &info );
+    }
+    else{
+        refreshSurfaceBand( surface, clip, refresh_mode, occluder );
+    }
+}
+
+bool ONScripterLabel::isLayerVisible()
+{
+    if ( layer_info == NULL ) return false;
+
+    int i, k;
+    for ( k=0 ; k<sprite_index.size() ; k++ ){
+        i = sprite_index[k];
+        if ( sprite_info[i].visible && sprite_info[i].trans_mode == AnimationInfo::TRANS_LAYER )
+            return true;
+    }
+    for ( k=0 ; k<sprite2_index.size() ; k++ ){
+        i = sprite2_index[k];
+        if ( sprite2_info[i].visible && sprite2_info[i].trans_mode == AnimationInfo::TRANS_LAYER )
+            return true;
+    }
+
+    return false;
+}
+
+// Returns the last sprite drawn by refreshSurfaceBand() that covers
+// clip opaquely, or -1.  Sprites are drawn in two runs, those behind
+// z_order (or behind 10 in saya mode) first, so the runs are searched
+// in the reverse order.
+int ONScripterLabel::findOccludingSprite( SDL_Rect &clip, int refresh_mode )
+{
+    if ( all_sprite_hide_flag ) return -1;
+
+    int i, k, x, y, top1, top2;
+    if ( z_order < 10 && refresh_mode & REFRESH_SAYA_MODE )
+        top1 = 9;
+    else
+        top1 = z_order;
+    if ( refresh_mode & REFRESH_SAYA_MODE )
+        top2 = 10;
+    else
+        top2 = 0;
+
+    for ( k=sprite_index.lowerBound(top2) ; k<sprite_index.size() ; k++ ){
+        i = sprite_index[k];
+        if ( i > z_order && i <= top1 ) continue;
+
+        AnimationInfo *anim = &sprite_info[i];
+        if ( !anim->image_surface || !anim->visible ) continue;
+
+        x = anim->pos.x;
+        y = anim->pos.y;
+        if ( !anim->abs_flag ){
+            x += sentence_font.x() * screen_ratio1 / screen_ratio2;
+            y += sentence_font.y() * screen_ratio1 / screen_ratio2;
+        }
+        if ( anim->isOpaqueOver( x, y, clip ) ) return i;
+    }
+
+    return -1;
+}
+
+void ONScripterLabel::refreshSurfaceBand( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int occluder )
+{
+    int i, k, top;
+
+    // the occluder hides everything drawn before it
+    if ( occluder >= 0 && occluder <= z_order ) goto front_sprites;
 
     if ( !all_sprite_hide_flag ){
         if ( z_order < 10 && refresh_mode & REFRESH_SAYA_MODE )
             top = 9;
         else
             top = z_order;
-        for ( i=MAX_SPRITE_NUM-1 ; i>top ; i-- ){
+        for ( k=sprite_index.lowerBound( (occluder > top) ? occluder+1 : MAX_SPRITE_NUM )-1 ;
+              k>=0 && (i=sprite_index[k]) > top ; k-- ){
             if ( sprite_info[i].image_surface && sprite_info[i].visible ){
                 drawTaggedSurface( surface, &sprite_info[i], clip );
             }
@@ -300,7 +423,8 @@ void ONScripterLabel::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src,
         if ( nega_mode == 2 ) makeNegaSurface( surface, clip );
 
         if (!all_sprite2_hide_flag){
-            for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
+            for ( k=sprite2_index.size()-1 ; k>=0 ; k-- ){
+                i = sprite2_index[k];
                 if ( sprite2_info[i].image_surface && sprite2_info[i].visible ){
                     drawTaggedSurface( surface, &sprite2_info[i], clip );
                 }
@@ -313,12 +437,14 @@ void ONScripterLabel::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src,
             text_info.blendOnSurface( surface, 0, 0, clip );
     }
 
+  front_sprites:
     if ( !all_sprite_hide_flag ){
         if ( refresh_mode & REFRESH_SAYA_MODE )
 	    top = 10;
         else
 	    top = 0;
-        for ( i=z_order ; i>=top ; i-- ){
+        for ( k=sprite_index.lowerBound( (occluder >= top && occluder <= z_order) ? occluder+1 : z_order+1 )-1 ;
+              k>=0 && (i=sprite_index[k]) >= top ; k-- ){
             if ( sprite_info[i].image_surface && sprite_info[i].visible ){
 	        drawTaggedSurface( surface, &sprite_info[i], clip );
             }
@@ -328,7 +454,8 @@ void ONScripterLabel::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src,
     if ( !windowback_flag ){
         //Mion - ogapee2008
         if (!all_sprite2_hide_flag){
-            for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
+            for ( k=sprite2_index.size()-1 ; k>=0 ; k-- ){
+                i = sprite2_index[k];
                 if ( sprite2_info[i].image_surface && sprite2_info[i].visible ){
                     drawTaggedSurface( surface, &sprite2_info[i], clip );
                 }
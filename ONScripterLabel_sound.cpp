@@ -56,6 +56,7 @@ extern bool ext_music_play_once_flag;
 extern "C"{
     extern void mp3callback( void *userdata, Uint8 *stream, int len );
     extern void oggcallback( void *userdata, Uint8 *stream, int len );
+    extern void resamplecallback( void *userdata, Uint8 *stream, int len );
     extern Uint32 SDLCALL cdaudioCallback( Uint32 interval, void *param );
 #if defined(MACOSX) && defined(INSANI)
 	extern Uint32 SDLCALL midiSDLCallback( Uint32 interval, void *param );
@@ -72,84 +73,63 @@ extern SDL_TimerID timer_midi_id;
 #define TMP_MIDI_FILE "tmp.mid"
 #define TMP_MUSIC_FILE "tmp.mus"
 
-#define SWAP_SHORT_BYTES(sptr){          \
-            Uint8 *bptr = (Uint8 *)sptr; \
-            Uint8 tmpb = *bptr;          \
-            *bptr = *(bptr+1);           \
-            *(bptr+1) = tmpb;            \
-        }
-
-extern long decodeOggVorbis(ONScripterLabel::MusicStruct *music_struct, Uint8 *buf_dst, long len, bool do_rate_conversion)
+// With mixer_flag, the samples are for the music hook: in the byte
+// order of the machine, with the music volume applied.  Otherwise
+// they are little endian, for a WAVE file.
+extern long decodeOggVorbis(ONScripterLabel::MusicStruct *music_struct, Uint8 *buf_dst, long len, bool mixer_flag)
 {
     int current_section;
     long total_len = 0;
 
     OVInfo *ovi = music_struct->ovi;
     char *buf = (char*)buf_dst;
-    if (do_rate_conversion && ovi->cvt.needed){
-        len = len * ovi->mult1 / ovi->mult2;
-        if (ovi->cvt_len < len*ovi->cvt.len_mult){
-            if (ovi->cvt.buf) delete[] ovi->cvt.buf;
-            ovi->cvt.buf = new Uint8[len*ovi->cvt.len_mult];
-            ovi->cvt_len = len*ovi->cvt.len_mult;
-        }
-        buf = (char*)ovi->cvt.buf;
-    }
 
 #ifdef USE_OGG_VORBIS
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    int bigendian = mixer_flag ? 1 : 0;
+#else
+    int bigendian = 0;
+#endif
     while(1){
 #ifdef INTEGER_OGG_VORBIS
         long src_len = ov_read( &ovi->ovf, buf, len, &current_section);
 #else
-        long src_len = ov_read( &ovi->ovf, buf, len, 0, 2, 1, &current_section);
+        long src_len = ov_read( &ovi->ovf, buf, len, bigendian, 2, 1, &current_section);
 #endif
         if (src_len <= 0) break;
 
-        long dst_len = src_len;
-        if (do_rate_conversion && ovi->cvt.needed){
-            ovi->cvt.len = src_len;
-            SDL_ConvertAudio(&ovi->cvt);
-            memcpy(buf_dst, ovi->cvt.buf, ovi->cvt.len_cvt);
-            dst_len = ovi->cvt.len_cvt;
-
-            if (music_struct->volume != DEFAULT_VOLUME){
-                // volume change under SOUND_OGG_STREAMING
-                for (int i=0 ; i<dst_len ; i+=2){
-                    short a = *(short*)(buf_dst+i);
-                    a = a*music_struct->volume/100;
-                    *(short*)(buf_dst+i) = a;
-                }
-            }
-            buf_dst += ovi->cvt.len_cvt;
-        }
-        else{
-            if (do_rate_conversion && music_struct->volume != DEFAULT_VOLUME){ 
-                // volume change under SOUND_OGG_STREAMING
-                for (int i=0 ; i<dst_len ; i+=2){
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-                    SWAP_SHORT_BYTES( ((short*)(buf_dst+i)) )
-#endif
-                    short a = *(short*)(buf_dst+i);
-                    a = a*music_struct->volume/100;
-                    *(short*)(buf_dst+i) = a;
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-                    SWAP_SHORT_BYTES( ((short*)(buf_dst+i)) )
-#endif
-                }
-            }
-            buf += dst_len;
-            buf_dst += dst_len;
-        }
-
-        total_len += dst_len;
+        buf += src_len;
+        total_len += src_len;
         if (src_len == len) break;
         len -= src_len;
     }
+
+    if (mixer_flag){
+        // volume change under SOUND_OGG_STREAMING, ramped over the buffer
+        int gain = volumeToGain(music_struct->volume);
+        applyGain((Sint16*)buf_dst, total_len/2, music_struct->gain, gain);
+        music_struct->gain = gain;
+    }
 #endif
 
     return total_len;
 }
 
+// sources of Resampler for the music hooks
+static int readOggVorbis(void *data, Uint8 *buf, int len)
+{
+    return decodeOggVorbis((ONScripterLabel::MusicStruct*)data, buf, len, true);
+}
+
+#ifndef MP3_MAD
+static int readSMPEG(void *data, Uint8 *buf, int len)
+{
+    // SMPEG mixes its samples into the buffer
+    memset(buf, 0, len);
+    return SMPEG_playAudio((SMPEG*)data, buf, len);
+}
+#endif
+
 int ONScripterLabel::playSound(const char *filename, int format, bool loop_flag, int channel)
 {
     if ( !audio_open_flag ) return SOUND_NONE;
@@ -166,6 +146,47 @@ int ONScripterLabel::playSound(const char *filename, int format, bool loop_flag,
             return SOUND_NONE;
     }
 
+    // voices are played once and streamed, so they are not cached
+    if ((format & (SOUND_WAVE | SOUND_OGG)) && channel != MIX_VOICE_CHANNEL){
+        int type;
+        Mix_Chunk *chunk = sound_cache.restore(filename, audio_format, &type);
+        if (chunk){
+            playWave(chunk, format, loop_flag, channel);
+            return type;
+        }
+    }
+
+    // Uncompressed archive entries are decoded straight from the
+    // archive mapping.  Only sounds decoded completely here can do
+    // so; streamed music keeps its own copy of the file.
+    if (!(format & (SOUND_MP3 | SOUND_OGG_STREAMING | SOUND_MIDI))){
+        size_t map_length;
+        const unsigned char *map_buf = script_h.cBR->getFileMap( filename, &map_length );
+        if (map_buf && (format & SOUND_OGG)){
+            int channels, rate;
+            OVInfo *ovi = openOggVorbis(map_buf, map_length, channels, rate);
+            if (ovi && !(format & SOUND_PRELOAD) &&
+                streamOGG(ovi, NULL, format, loop_flag, channel) == 0)
+                return SOUND_OGG;
+            if (ovi){
+                Mix_Chunk *chunk = decodeOGGChunk(ovi, channels, rate, channel);
+                closeOggVorbis(ovi);
+                if (channel != MIX_VOICE_CHANNEL)
+                    sound_cache.store(filename, audio_format, chunk, SOUND_OGG);
+                playWave(chunk, format, loop_flag, channel);
+                return SOUND_OGG;
+            }
+        }
+        if (map_buf && (format & SOUND_WAVE) &&
+            strncmp((const char*) map_buf, "RIFF", 4) == 0){
+            Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromConstMem(map_buf, map_length), 1);
+            if (channel != MIX_VOICE_CHANNEL)
+                sound_cache.store(filename, audio_format, chunk, SOUND_WAVE);
+            if (playWave(chunk, format, loop_flag, channel) == 0)
+                return SOUND_WAVE;
+        }
+    }
+
     unsigned char *buffer;
 
     if ((format & (SOUND_MP3 | SOUND_OGG_STREAMING)) && 
@@ -179,7 +200,7 @@ int ONScripterLabel::playSound(const char *filename, int format, bool loop_flag,
     }
 
     if (format & (SOUND_OGG | SOUND_OGG_STREAMING)){
-        int ret = playOGG(format, buffer, length, loop_flag, channel);
+        int ret = playOGG(format, buffer, length, loop_flag, channel, filename);
         if (ret & (SOUND_OGG | SOUND_OGG_STREAMING)) return ret;
     }
 
@@ -209,6 +230,8 @@ int ONScripterLabel::playSound(const char *filename, int format, bool loop_flag,
             delete[] fmtname;
         }
         Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer, length), 1);
+        if (channel != MIX_VOICE_CHANNEL)
+            sound_cache.store(filename, audio_format, chunk, SOUND_WAVE);
         if (playWave(chunk, format, loop_flag, channel) == 0){
             delete[] buffer;
             return SOUND_WAVE;
@@ -310,6 +333,7 @@ int ONScripterLabel::playWave(Mix_Chunk *chunk, int format, bool loop_flag, int
     if (!chunk) return -1;
 
     Mix_Pause( channel );
+    Mix_UnregisterAllEffects( channel ); // ends a streamed sound
     if ( wave_sample[channel] ) Mix_FreeChunk( wave_sample[channel] );
     wave_sample[channel] = chunk;
 
@@ -335,72 +359,86 @@ int ONScripterLabel::playMP3()
     }
 
 #ifndef MP3_MAD
-    SDL_AudioSpec wanted;
-    SMPEG_wantedSpec( mp3_sample, &wanted );
-    if ((wanted.format != audio_format.format) ||
-        (wanted.freq != audio_format.freq)) {
-        Mix_CloseAudio();
-        openAudio(wanted.freq, wanted.format, wanted.channels);
-        if (!audio_open_flag) {
-            // didn't work, use the old settings
-            openAudio();
-       }
-    }
+    // SMPEG keeps the rate of the stream; see hookSMPEG()
+    SDL_AudioSpec spec;
+    SMPEG_wantedSpec( mp3_sample, &spec );
+    spec.format = AUDIO_S16SYS;
+    spec.channels = audio_format.channels;
     SMPEG_enableaudio( mp3_sample, 0 );
-    SMPEG_actualSpec( mp3_sample, &audio_format );
+    SMPEG_actualSpec( mp3_sample, &spec );
     SMPEG_enableaudio( mp3_sample, 1 );
-#endif
+    SMPEG_setvolume( mp3_sample, music_volume );
+    hookSMPEG( mp3_sample, spec.freq );
+#else
     SMPEG_setvolume( mp3_sample, music_volume );
     Mix_HookMusic( mp3callback, mp3_sample );
+#endif
     SMPEG_play( mp3_sample );
 
     return 0;
 }
 
-int ONScripterLabel::playOGG(int format, unsigned char *buffer, long length, bool loop_flag, int channel)
+#ifndef MP3_MAD
+// The mixer stays at the spec it was opened with; SMPEG decodes at
+// freq in the channels of the mixer, and music_resampler converts
+// the rate if it differs.
+void ONScripterLabel::hookSMPEG( SMPEG *mpeg, int freq )
+{
+    SDL_LockAudio();
+    if ( music_resampler.setup( freq, audio_format.channels, AUDIO_S16SYS, audio_format ) &&
+         music_resampler.isNeeded() ){
+        music_resampler.setSource( readSMPEG, mpeg );
+        Mix_HookMusic( resamplecallback, &music_resampler );
+    }
+    else{
+        Mix_HookMusic( mp3callback, mpeg );
+    }
+    SDL_UnlockAudio();
+}
+#endif
+
+int ONScripterLabel::playOGG(int format, unsigned char *buffer, long length, bool loop_flag, int channel, const char *filename)
 {
     int channels, rate;
     OVInfo *ovi = openOggVorbis(buffer, length, channels, rate);
     if (ovi == NULL) return SOUND_OTHER;
 
     if (format & SOUND_OGG){
-        unsigned char *buffer2 = new unsigned char[sizeof(WAVE_HEADER)+ovi->decoded_length];
-        
-        MusicStruct ms;
-        ms.ovi = ovi;
-        ms.volume = channelvolumes[channel];
-        decodeOggVorbis(&ms, (Uint8*)(buffer2+sizeof(WAVE_HEADER)), ovi->decoded_length, false);
-        setupWaveHeader(buffer2, channels, rate, 16, ovi->decoded_length);
-        Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer2, sizeof(WAVE_HEADER)+ovi->decoded_length), 1);
-        delete[] buffer2;
+        if (!(format & SOUND_PRELOAD) &&
+            streamOGG(ovi, buffer, format, loop_flag, channel) == 0)
+            return SOUND_OGG;
+
+        Mix_Chunk *chunk = decodeOGGChunk(ovi, channels, rate, channel);
         closeOggVorbis(ovi);
         delete[] buffer;
+        if (channel != MIX_VOICE_CHANNEL)
+            sound_cache.store(filename, audio_format, chunk, SOUND_OGG);
 
         playWave(chunk, format, loop_flag, channel);
 
         return SOUND_OGG;
     }
 
-    if ((audio_format.format != AUDIO_S16) ||
-        (audio_format.freq != rate)) {
-        Mix_CloseAudio();
-        openAudio(rate, AUDIO_S16, channels);
-        ovi->cvt.needed = 0;
-        if (!audio_open_flag) {
-            // didn't work, use the old settings
-            openAudio();
-            ovi->cvt_len = 0;
-            SDL_BuildAudioCVT(&ovi->cvt,
-                      AUDIO_S16, channels, rate,
-                      audio_format.format, audio_format.channels, audio_format.freq);
-            ovi->mult1 = 10;
-            ovi->mult2 = (int)(ovi->cvt.len_ratio*10.0);
-       }
+    // the mixer stays at the spec it was opened with
+    SDL_LockAudio();
+    if (!music_resampler.setup(rate, channels, AUDIO_S16SYS, audio_format)){
+        SDL_UnlockAudio();
+        fprintf(stderr, "can't play %d channel Ogg Vorbis music\n", channels);
+        closeOggVorbis(ovi);
+        return SOUND_OTHER;
     }
 
     music_struct.ovi = ovi;
     music_struct.volume = music_volume;
-    Mix_HookMusic(oggcallback, &music_struct);
+    music_struct.gain = volumeToGain(music_volume);
+    if (music_resampler.isNeeded()){
+        music_resampler.setSource(readOggVorbis, &music_struct);
+        Mix_HookMusic(resamplecallback, &music_resampler);
+    }
+    else{
+        Mix_HookMusic(oggcallback, &music_struct);
+    }
+    SDL_UnlockAudio();
 
     music_buffer = buffer;
     music_buffer_length = length;
@@ -408,6 +446,141 @@ int ONScripterLabel::playOGG(int format, unsigned char *buffer, long length, boo
     return SOUND_OGG_STREAMING;
 }
 
+Mix_Chunk *ONScripterLabel::decodeOGGChunk(OVInfo *ovi, int channels, int rate, int channel)
+{
+    unsigned char *buffer2 = new unsigned char[sizeof(WAVE_HEADER)+ovi->decoded_length];
+        
+    MusicStruct ms;
+    ms.ovi = ovi;
+    ms.volume = channelvolumes[channel];
+    decodeOggVorbis(&ms, (Uint8*)(buffer2+sizeof(WAVE_HEADER)), ovi->decoded_length, false);
+    setupWaveHeader(buffer2, channels, rate, 16, ovi->decoded_length);
+    Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer2, sizeof(WAVE_HEADER)+ovi->decoded_length), 1);
+    delete[] buffer2;
+
+    return chunk;
+}
+
+// A sound effect or voice being decoded while it plays.  The
+// channel plays a silent chunk of the length of the decoded sound,
+// so that SDL_mixer keeps track of the position, the looping and
+// the end of the sound; streamOGGEffect() replaces the silence
+// with the decoded samples.
+struct OggStream{
+    OVInfo *ovi;
+    unsigned char *buffer; // the file if it is not mapped from the archive
+    Uint8 *pcm; // decoded and converted, from pcm_pos to pcm_len
+    long pcm_pos, pcm_len;
+    long chunk_pos, chunk_len;
+};
+
+#define OGG_STREAM_BLOCK 4096 // bytes of 16-bit samples decoded at once
+
+int ONScripterLabel::streamOGG(OVInfo *ovi, unsigned char *buffer, int format, bool loop_flag, int channel)
+{
+#ifndef USE_OGG_VORBIS
+    return -1;
+#else
+    if (ovi->decoded_length == 0) return -1;
+
+    // length of the decoded sound in the format of the mixer
+    vorbis_info *vi = ov_info( &ovi->ovf, -1 );
+    long frames = (long)((Sint64)(ovi->decoded_length / (vi->channels * 2)) * audio_format.freq / vi->rate);
+    long chunk_len = frames * audio_format.channels * ((audio_format.format & 0xff) / 8);
+    if (chunk_len == 0) return -1;
+    // short effects are decoded once and kept in the sound cache;
+    // voices are always streamed
+    if (channel != MIX_VOICE_CHANNEL && sound_cache.fits(chunk_len)) return -1;
+
+    // calloc()'ed zeros cost nothing until they are written, which
+    // they never are
+    Uint8 *silence = (Uint8*)calloc(chunk_len, 1);
+    if (silence == NULL) return -1;
+    Mix_Chunk *chunk = Mix_QuickLoad_RAW(silence, chunk_len);
+    if (chunk == NULL){
+        free(silence);
+        return -1;
+    }
+    chunk->allocated = 1; // Mix_FreeChunk() frees the silence
+
+    if (ovi->cvt_len < OGG_STREAM_BLOCK*ovi->cvt.len_mult){
+        if (ovi->cvt.buf) delete[] ovi->cvt.buf;
+        ovi->cvt.buf = new Uint8[OGG_STREAM_BLOCK*ovi->cvt.len_mult];
+        ovi->cvt_len = OGG_STREAM_BLOCK*ovi->cvt.len_mult;
+    }
+
+    OggStream *stream = new OggStream();
+    stream->ovi = ovi;
+    stream->buffer = buffer;
+    stream->pcm = ovi->cvt.buf;
+    stream->pcm_pos = stream->pcm_len = 0;
+    stream->chunk_pos = 0;
+    stream->chunk_len = chunk_len;
+
+    // register the effect before the mixer gets to the silence
+    SDL_LockAudio();
+    playWave(chunk, format, loop_flag, channel);
+    Mix_RegisterEffect(channel, streamOGGEffect, streamOGGDone, stream);
+    SDL_UnlockAudio();
+
+    return 0;
+#endif
+}
+
+void ONScripterLabel::streamOGGEffect(int chan, void *stream, int len, void *udata)
+{
+#ifdef USE_OGG_VORBIS
+    OggStream *os = (OggStream*)udata;
+    OVInfo *ovi = os->ovi;
+
+    Uint8 *dst = (Uint8*)stream;
+    long rest = len;
+    while (rest > 0){
+        if (os->pcm_pos == os->pcm_len){
+            int current_section;
+#ifdef INTEGER_OGG_VORBIS
+            long src_len = ov_read( &ovi->ovf, (char*)os->pcm, OGG_STREAM_BLOCK, &current_section);
+#else
+            long src_len = ov_read( &ovi->ovf, (char*)os->pcm, OGG_STREAM_BLOCK, 0, 2, 1, &current_section);
+#endif
+            // past the end the chunk plays its own silence
+            if (src_len <= 0) break;
+            os->pcm_len = src_len;
+            if (ovi->cvt.needed){
+                ovi->cvt.len = src_len;
+                SDL_ConvertAudio(&ovi->cvt);
+                os->pcm_len = ovi->cvt.len_cvt;
+            }
+            os->pcm_pos = 0;
+        }
+
+        long n = os->pcm_len - os->pcm_pos;
+        if (n > rest) n = rest;
+        memcpy(dst, os->pcm + os->pcm_pos, n);
+        os->pcm_pos += n;
+        dst += n;
+        rest -= n;
+    }
+
+    // the mixer never passes the end of the chunk in one call, so
+    // this is where a looping chunk starts over
+    os->chunk_pos += len;
+    if (os->chunk_pos >= os->chunk_len){
+        os->chunk_pos = 0;
+        os->pcm_pos = os->pcm_len = 0;
+        ov_pcm_seek(&ovi->ovf, 0);
+    }
+#endif
+}
+
+void ONScripterLabel::streamOGGDone(int chan, void *udata)
+{
+    OggStream *os = (OggStream*)udata;
+    closeOggVorbis(os->ovi);
+    if (os->buffer) delete[] os->buffer;
+    delete os;
+}
+
 int ONScripterLabel::playExternalMusic(bool loop_flag)
 {
     int music_looping = loop_flag ? -1 : 0;
@@ -491,7 +664,6 @@ int ONScripterLabel::playMPEG( const char *filename, bool async_flag, bool use_p
 {
     int ret = 0;
 #ifndef MP3_MAD
-    bool different_spec = false;
     unsigned long length = script_h.cBR->getFileLength( filename );
     if (movie_buffer) delete[] movie_buffer;
     movie_buffer = new unsigned char[length];
@@ -509,26 +681,14 @@ int ONScripterLabel::playMPEG( const char *filename, bool async_flag, bool use_p
     if ( !SMPEG_error( mpeg_sample ) ){
         SMPEG_enableaudio( mpeg_sample, 0 );
 
+        SDL_AudioSpec spec;
+        if ( !SMPEG_wantedSpec( mpeg_sample, &spec ) )
+            spec.freq = audio_format.freq;
         if ( audio_open_flag ){
-            //Mion - SMPEG doesn't handle different audio spec well, so
-            // let's redo the SDL mixer just for this video playback
-            SDL_AudioSpec wanted;
-            SMPEG_wantedSpec( mpeg_sample, &wanted );
-            //printf("SMPEG wants audio: %d Hz %d bit %s\n", wanted.freq,
-            //       (wanted.format&0xFF),
-            //       (wanted.channels > 1) ? "stereo" : "mono");
-            if ((wanted.format != audio_format.format) ||
-                (wanted.freq != audio_format.freq)) {
-                different_spec = true;
-                Mix_CloseAudio();
-                openAudio(wanted.freq, wanted.format, wanted.channels);
-                if (!audio_open_flag) {
-                    // didn't work, use the old settings
-                    openAudio();
-                    different_spec = false;
-                }
-            }
-            SMPEG_actualSpec( mpeg_sample, &audio_format );
+            // SMPEG keeps the rate of the stream; see hookSMPEG()
+            spec.format = AUDIO_S16SYS;
+            spec.channels = audio_format.channels;
+            SMPEG_actualSpec( mpeg_sample, &spec );
             SMPEG_enableaudio( mpeg_sample, 1 );
         }
         SMPEG_enablevideo( mpeg_sample, 1 );
@@ -539,7 +699,7 @@ int ONScripterLabel::playMPEG( const char *filename, bool async_flag, bool use_p
         }
         SMPEG_setvolume( mpeg_sample, music_volume );
 
-        Mix_HookMusic( mp3callback, mpeg_sample );
+        hookSMPEG( mpeg_sample, spec.freq );
 
         if (use_pos) {
             async_movie_rect.x = xpos;
@@ -613,12 +773,6 @@ int ONScripterLabel::playMPEG( const char *filename, bool async_flag, bool use_p
         }
 
         stopMovie(mpeg_sample);
-
-        if (different_spec) {
-            //restart mixer with the old audio spec
-            Mix_CloseAudio();
-            openAudio();
-        }
     }
 
 #else
@@ -851,7 +1005,7 @@ static long oc_tell_func(void *datasource)
     return (long)ogg_vorbis_info->pos;
 }
 #endif
-OVInfo *ONScripterLabel::openOggVorbis( unsigned char *buf, long len, int &channels, int &rate )
+OVInfo *ONScripterLabel::openOggVorbis( const unsigned char *buf, long len, int &channels, int &rate )
 {
     OVInfo *ovi = NULL;
 
@@ -888,8 +1042,6 @@ OVInfo *ONScripterLabel::openOggVorbis( unsigned char *buf, long len, int &chann
     SDL_BuildAudioCVT(&ovi->cvt,
                       AUDIO_S16, channels, rate,
                       audio_format.format, audio_format.channels, audio_format.freq);
-    ovi->mult1 = 10;
-    ovi->mult2 = (int)(ovi->cvt.len_ratio*10.0);
 
     ovi->decoded_length = (long)(ov_pcm_total(&ovi->ovf, -1) * channels * 2);
 #endif
@@ -41,40 +41,7 @@ extern unsigned short convSJIS2UTF16( unsigned short in );
 #define IS_TRANSLATION_REQUIRED(x)	\
         ( (*(x) == (char)0x81) && (*((x)+1) >= 0x41) && (*((x)+1) <= 0x44) )
 
-SDL_Surface *ONScripterLabel::renderGlyph(TTF_Font *font, Uint16 text)
-{
-    GlyphCache *gc = root_glyph_cache;
-    GlyphCache *pre_gc = gc;
-    while(1){
-        if (gc->text == text &&
-            gc->font == font){
-            if (gc != pre_gc){
-                pre_gc->next = gc->next;
-                gc->next = root_glyph_cache;
-                root_glyph_cache = gc;
-            }
-            return gc->surface;
-        }
-        if (gc->next == NULL) break;
-        pre_gc = gc;
-        gc = gc->next;
-    }
-
-    pre_gc->next = NULL;
-    gc->next = root_glyph_cache;
-    root_glyph_cache = gc;
-
-    gc->text = text;
-    gc->font = font;
-    if (gc->surface) SDL_FreeSurface(gc->surface);
-
-    static SDL_Color fcol={0xff, 0xff, 0xff}, bcol={0, 0, 0};
-    gc->surface = TTF_RenderGlyph_Shaded( font, text, fcol, bcol );
-
-    return gc->surface;
-}
-
-void ONScripterLabel::drawGlyph( SDL_Surface *dst_surface, Fontinfo *info, SDL_Color &color, char* text, int xy[2], bool shadow_flag, AnimationInfo *cache_info, SDL_Rect *clip, SDL_Rect &dst_rect )
+static unsigned short textToUnicode( const char *text )
 {
     unsigned short unicode;
     if (IS_TWO_BYTE(text[0])){
@@ -87,26 +54,53 @@ void ONScripterLabel::drawGlyph( SDL_Surface *dst_surface, Fontinfo *info, SDL_C
         else unicode = text[0];
     }
 
-    int minx, maxx, miny, maxy, advanced;
+    return unicode;
+}
+
+// Render the characters of the script with the text font before
+// the script starts, so that the first pages only hit the glyph
+// cache.  Sizes set later by setwindow are rendered as they are used.
+void ONScripterLabel::preloadGlyphs()
+{
+    if ( sentence_font.ttf_font == NULL &&
+         sentence_font.openFont( font_file, screen_ratio1, screen_ratio2 ) == NULL )
+        return;
+
+    unsigned short *chars;
+    int num = script_h.collectChars( &chars );
+
+    Uint16 *unicode = new Uint16[num];
+    char text[2];
+    for ( int i=0 ; i<num ; i++ ){
+        text[0] = (chars[i] > 0xff) ? chars[i] >> 8 : chars[i];
+        text[1] = chars[i] & 0xff;
+        unicode[i] = textToUnicode( text );
+    }
+    glyph_cache.preload( (TTF_Font*)sentence_font.ttf_font, unicode, num );
+    delete[] unicode;
+    delete[] chars;
+}
+
+void ONScripterLabel::drawGlyph( SDL_Surface *dst_surface, Fontinfo *info, SDL_Color &color, char* text, int xy[2], bool shadow_flag, AnimationInfo *cache_info, SDL_Rect *clip, SDL_Rect &dst_rect )
+{
+    unsigned short unicode = textToUnicode( text );
+
 #if 0
     if (TTF_GetFontStyle( (TTF_Font*)info->ttf_font ) !=
         (info->is_bold?TTF_STYLE_BOLD:TTF_STYLE_NORMAL) )
         TTF_SetFontStyle( (TTF_Font*)info->ttf_font, (info->is_bold?TTF_STYLE_BOLD:TTF_STYLE_NORMAL));
 #endif
-    TTF_GlyphMetrics( (TTF_Font*)info->ttf_font, unicode,
-                      &minx, &maxx, &miny, &maxy, &advanced );
-    //printf("min %d %d %d %d %d %d\n", minx, maxx, miny, maxy, advanced,TTF_FontAscent((TTF_Font*)info->ttf_font)  );
-
-    SDL_Surface *tmp_surface = renderGlyph( (TTF_Font*)info->ttf_font, unicode );
+    GlyphCache::Glyph *glyph = glyph_cache.find( (TTF_Font*)info->ttf_font, unicode );
+    SDL_Surface *tmp_surface = glyph->surface;
 
     bool rotate_flag = false;
     if ( (info->getTateyokoMode() == Fontinfo::TATE_MODE) &&
          IS_ROTATION_REQUIRED(text) )
         rotate_flag = true;
 
-    dst_rect.x = xy[0] + minx;
-    dst_rect.y = xy[1] + TTF_FontAscent((TTF_Font*)info->ttf_font) - maxy;
-    if ( rotate_flag ) dst_rect.x += miny - minx;
+    dst_rect.x = xy[0] + glyph->minx;
+    dst_rect.y = xy[1] + glyph->ascent - glyph->maxy;
+    if ( rotate_flag ) dst_rect.x += glyph->miny - glyph->minx;
 
     if ( (info->getTateyokoMode() == Fontinfo::TATE_MODE) &&
          IS_TRANSLATION_REQUIRED(text) ){
@@ -195,7 +189,23 @@ void ONScripterLabel::drawChar( char* text, Fontinfo *info, bool flush_flag, boo
     }
     else if ( flush_flag ){
         info->addShadeArea(dst_rect, shade_distance);
-        flushDirect( dst_rect, REFRESH_NONE_MODE );
+        // left to the event loop, which puts the characters drawn
+        // within a frame on the screen at once
+        if ( dst_rect.w > 0 && dst_rect.h > 0 ){
+            if ( text_flush_pending ){
+                int x2 = text_flush_rect.x + text_flush_rect.w;
+                int y2 = text_flush_rect.y + text_flush_rect.h;
+                if ( x2 < dst_rect.x + dst_rect.w ) x2 = dst_rect.x + dst_rect.w;
+                if ( y2 < dst_rect.y + dst_rect.h ) y2 = dst_rect.y + dst_rect.h;
+                if ( text_flush_rect.x > dst_rect.x ) text_flush_rect.x = dst_rect.x;
+                if ( text_flush_rect.y > dst_rect.y ) text_flush_rect.y = dst_rect.y;
+                text_flush_rect.w = x2 - text_flush_rect.x;
+                text_flush_rect.h = y2 - text_flush_rect.y;
+            }
+            else
+                text_flush_rect = dst_rect;
+            text_flush_pending = true;
+        }
     }
 
     /* ---------------------------------------- */
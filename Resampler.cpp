@@ -0,0 +1,287 @@
+/* -*- C++ -*-
+ *
+ *  Resampler.cpp - polyphase sample rate converter for streamed music
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Resampler.h"
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define KAISER_BETA 8.0
+#define PASSBAND 0.9 // part of the lower Nyquist frequency kept
+
+static double besselI0( double x )
+{
+    double sum = 1.0, term = 1.0;
+    for ( int k=1 ; k<50 ; k++ ){
+        term *= (x / (2*k)) * (x / (2*k));
+        sum += term;
+        if ( term < sum * 1e-12 ) break;
+    }
+    return sum;
+}
+
+// n is a multiple of 8
+static inline Sint32 dotProduct( const Sint16 *x, const Sint16 *h, int n )
+{
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for ( int i=0 ; i<n ; i+=8 ){
+        __m128i a = _mm_loadu_si128( (const __m128i*)(x+i) );
+        __m128i b = _mm_loadu_si128( (const __m128i*)(h+i) );
+        acc = _mm_add_epi32( acc, _mm_madd_epi16( a, b ) );
+    }
+    acc = _mm_add_epi32( acc, _mm_shuffle_epi32( acc, _MM_SHUFFLE(1,0,3,2) ) );
+    acc = _mm_add_epi32( acc, _mm_shuffle_epi32( acc, _MM_SHUFFLE(2,3,0,1) ) );
+    return _mm_cvtsi128_si32( acc );
+#else
+    Sint32 sum = 0;
+    for ( int i=0 ; i<n ; i++ ) sum += x[i] * h[i];
+    return sum;
+#endif
+}
+
+Resampler::Resampler()
+{
+    needed = false;
+    taps = 1;
+    coef = NULL;
+    buf[0] = buf[1] = NULL;
+    read_buf = NULL;
+    buf_frames = num_frames = pos = 0;
+    pos_frac = 0;
+    source = NULL;
+    source_data = NULL;
+}
+
+Resampler::~Resampler()
+{
+    if ( coef ) delete[] coef;
+    if ( buf[0] ) delete[] buf[0];
+    if ( buf[1] ) delete[] buf[1];
+    if ( read_buf ) delete[] read_buf;
+}
+
+// in_format is AUDIO_S16LSB or AUDIO_S16MSB.  Returns false if the
+// conversion is not supported.
+bool Resampler::setup( int in_rate, int in_channels, Uint16 in_format, SDL_AudioSpec &out )
+{
+    if ( in_rate <= 0 || out.freq <= 0 ||
+         in_channels < 1 || in_channels > 2 ||
+         out.channels < 1 || out.channels > 2 ||
+         ( in_format != AUDIO_S16LSB && in_format != AUDIO_S16MSB ) ||
+         ( (out.format & 0xff) != 8 && (out.format & 0xff) != 16 ) )
+        return false;
+
+    this->in_rate = in_rate;
+    this->in_channels = in_channels;
+    in_swap = ( in_format != AUDIO_S16SYS );
+    out_rate = out.freq;
+    out_channels = out.channels;
+    out_format = out.format;
+    needed = ( in_rate != out_rate || in_channels != out_channels || in_format != out_format );
+
+    step = in_rate / out_rate;
+    step_frac = in_rate % out_rate;
+
+    if ( coef ){
+        delete[] coef;
+        coef = NULL;
+    }
+    taps = 1;
+
+    if ( in_rate != out_rate ){
+        double fc = 0.5 * PASSBAND; // in cycles per input frame
+        taps = RESAMPLER_TAPS;
+        if ( out_rate < in_rate ){
+            // the filter widens along with the cutoff going down
+            fc = fc * out_rate / in_rate;
+            taps = ( RESAMPLER_TAPS * in_rate / out_rate + 7 ) & ~7;
+            if ( taps > RESAMPLER_MAX_TAPS ) taps = RESAMPLER_MAX_TAPS;
+        }
+
+        coef = new Sint16[ (RESAMPLER_PHASES+1) * taps ];
+        double h[RESAMPLER_MAX_TAPS];
+        double i0_beta = besselI0( KAISER_BETA );
+        int center = (taps-1) / 2;
+        for ( int p=0 ; p<=RESAMPLER_PHASES ; p++ ){
+            double sum = 0.0;
+            for ( int k=0 ; k<taps ; k++ ){
+                double d = k - center - (double)p / RESAMPLER_PHASES;
+                double x = d / (taps / 2);
+                double w = 0.0;
+                if ( x > -1.0 && x < 1.0 )
+                    w = besselI0( KAISER_BETA * sqrt( 1.0 - x*x ) ) / i0_beta;
+                if ( d == 0.0 ) h[k] = 2.0 * fc;
+                else            h[k] = sin( 2.0 * M_PI * fc * d ) / (M_PI * d);
+                h[k] *= w;
+                sum += h[k];
+            }
+            // unity gain at DC; carry the rounding errors along so
+            // that every row adds up to exactly 1.0 in Q15
+            double acc = 0.0;
+            int isum = 0;
+            Sint16 *c = coef + p * taps;
+            for ( int k=0 ; k<taps ; k++ ){
+                acc += h[k] * 32768.0 / sum;
+                int v = (int)floor( acc + 0.5 ) - isum;
+                if      ( v >  32767 ) v =  32767;
+                else if ( v < -32767 ) v = -32767;
+                c[k] = v;
+                isum += v;
+            }
+        }
+    }
+
+    int frames = RESAMPLER_BLOCK + taps + step;
+    if ( frames > buf_frames ){
+        if ( buf[0] ) delete[] buf[0];
+        if ( buf[1] ) delete[] buf[1];
+        if ( read_buf ) delete[] read_buf;
+        buf_frames = frames;
+        buf[0] = new Sint16[ buf_frames ];
+        buf[1] = new Sint16[ buf_frames ];
+        read_buf = new Uint8[ buf_frames * 2 * 2 ];
+    }
+    reset();
+
+    return true;
+}
+
+void Resampler::setSource( SourceFunc func, void *data )
+{
+    source = func;
+    source_data = data;
+}
+
+// forget the samples read so far, as when the source starts over
+void Resampler::reset()
+{
+    // the first output frame is centered on the first input frame
+    num_frames = (taps-1) / 2;
+    for ( int i=0 ; i<2 ; i++ )
+        if ( buf[i] ) memset( buf[i], 0, num_frames * sizeof(Sint16) );
+    pos = 0;
+    pos_frac = 0;
+}
+
+bool Resampler::fill()
+{
+    if ( pos >= num_frames ){
+        pos -= num_frames;
+        num_frames = 0;
+    }
+    else{
+        num_frames -= pos;
+        for ( int i=0 ; i<in_channels ; i++ )
+            memmove( buf[i], buf[i] + pos, num_frames * sizeof(Sint16) );
+        pos = 0;
+    }
+
+    int frame = in_channels * 2;
+    int len = source( source_data, read_buf, (buf_frames - num_frames) * frame );
+    if ( len <= 0 ) return false;
+
+    int n = len / frame;
+    Sint16 *src = (Sint16*)read_buf;
+    for ( int i=0 ; i<n ; i++ ){
+        for ( int j=0 ; j<in_channels ; j++ ){
+            Sint16 s = *src++;
+            if ( in_swap ) s = (Sint16)SDL_Swap16( (Uint16)s );
+            buf[j][num_frames] = s;
+        }
+        num_frames++;
+    }
+
+    return true;
+}
+
+// Q15 sample of channel ch at the window position, phase + frac/256
+// RESAMPLER_PHASES-ths of a frame past it
+Sint32 Resampler::filter( int ch, int phase, int frac )
+{
+    const Sint16 *x = buf[ch] + pos;
+    const Sint16 *h = coef + phase * taps;
+    Sint32 a = dotProduct( x, h, taps );
+    Sint32 b = dotProduct( x, h + taps, taps );
+
+    return a + (Sint32)( (((Sint64)b - a) * frac) >> 8 );
+}
+
+int Resampler::resample( Uint8 *dst, int len )
+{
+    int bytes = (out_format & 0xff) / 8;
+    int frame = out_channels * bytes;
+    bool out_signed = (out_format & 0x8000) != 0;
+    bool out_swap = bytes == 2 && (out_format & 0x1000) != (AUDIO_S16SYS & 0x1000);
+
+    int n = len / frame, done = 0;
+    while ( done < n ){
+        if ( pos + taps > num_frames ){
+            if ( !fill() ) break;
+            continue;
+        }
+
+        Sint32 v[2];
+        if ( coef ){
+            Uint32 p = (Uint32)( ((Uint64)pos_frac * RESAMPLER_PHASES * 256) / out_rate );
+            for ( int i=0 ; i<in_channels ; i++ )
+                v[i] = ( filter( i, p >> 8, p & 0xff ) + (1 << 14) ) >> 15;
+        }
+        else{
+            for ( int i=0 ; i<in_channels ; i++ )
+                v[i] = buf[i][pos];
+        }
+
+        if ( in_channels == 1 )      v[1] = v[0];
+        else if ( out_channels == 1 ) v[0] = (v[0] + v[1]) >> 1;
+
+        for ( int i=0 ; i<out_channels ; i++ ){
+            Sint32 s = v[i];
+            if      ( s >  32767 ) s =  32767;
+            else if ( s < -32768 ) s = -32768;
+            if ( bytes == 2 ){
+                Uint16 u = (Uint16)s;
+                if ( !out_signed ) u ^= 0x8000;
+                if ( out_swap ) u = SDL_Swap16( u );
+                *(Uint16*)dst = u;
+            }
+            else{
+                Uint8 u = (Uint8)(s >> 8);
+                if ( !out_signed ) u ^= 0x80;
+                *dst = u;
+            }
+            dst += bytes;
+        }
+        done++;
+
+        pos += step;
+        pos_frac += step_frac;
+        if ( pos_frac >= (Uint32)out_rate ){
+            pos_frac -= out_rate;
+            pos++;
+        }
+    }
+
+    return done * frame;
+}
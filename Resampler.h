@@ -0,0 +1,80 @@
+/* -*- C++ -*-
+ *
+ *  Resampler.h - polyphase sample rate converter for streamed music
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __RESAMPLER_H__
+#define __RESAMPLER_H__
+
+#include <SDL.h>
+
+#define RESAMPLER_TAPS 64 // filter length when upsampling
+#define RESAMPLER_MAX_TAPS 256
+#define RESAMPLER_PHASES 256
+#define RESAMPLER_BLOCK 1024 // frames read from the source at once
+
+// Converts 16-bit samples of one or two channels to the spec the
+// mixer is open with, so that music of any rate can be played
+// without reopening the audio device.  The samples are pulled from
+// a source function as needed; it returns the number of bytes it
+// wrote, 0 if there is nothing more to play for now.
+//
+// The filter is a Kaiser windowed sinc, tabulated in Q15 for
+// RESAMPLER_PHASES positions between two input frames; the output
+// interpolates linearly between the two nearest positions.
+class Resampler
+{
+public:
+    typedef int (*SourceFunc)( void *data, Uint8 *buf, int len );
+
+    Resampler();
+    ~Resampler();
+
+    bool setup( int in_rate, int in_channels, Uint16 in_format, SDL_AudioSpec &out );
+    bool isNeeded(){ return needed; };
+    void setSource( SourceFunc func, void *data );
+    void reset();
+
+    // fills up to len bytes of dst; returns the number of bytes written
+    int resample( Uint8 *dst, int len );
+
+private:
+    bool fill();
+    Sint32 filter( int ch, int phase, int frac );
+
+    bool needed;
+    int in_rate, in_channels;
+    bool in_swap;
+    int out_rate, out_channels;
+    Uint16 out_format;
+    int step; // input frames per output frame
+    Uint32 step_frac; // and out_rate-ths of a frame
+
+    int taps;
+    Sint16 *coef; // (RESAMPLER_PHASES+1) rows of taps, NULL if the rates match
+
+    Sint16 *buf[2]; // input, one array per channel
+    Uint8 *read_buf;
+    int buf_frames; // capacity of buf
+    int num_frames, pos; // frames in buf, first frame of the window
+    Uint32 pos_frac; // 0 <= pos_frac < out_rate
+
+    SourceFunc source;
+    void *source_data;
+};
+
+#endif // __RESAMPLER_H__
@@ -22,6 +22,13 @@
  */
 
 #include "SarReader.h"
+#include "HashIndex.h"
+#if !defined(WIN32) && !defined(MACOS9) && !defined(PSP) && !defined(__OS2__)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
 #define WRITE_LENGTH 4096
 
 SarReader::SarReader( DirPaths *path, const unsigned char *key_table )
@@ -29,6 +36,9 @@ SarReader::SarReader( DirPaths *path, const unsigned char *key_table )
 {
     root_archive_info = last_archive_info = &archive_info;
     num_of_sar_archives = 0;
+
+    file_index = NULL;
+    file_index_size = file_index_num = 0;
 }
 
 SarReader::~SarReader()
@@ -54,6 +64,8 @@ int SarReader::open( const char *name, int archive_type )
     last_archive_info = last_archive_info->next;
     num_of_sar_archives++;
 
+    addFileIndex( info );
+
     return 0;
 }
 
@@ -113,10 +125,37 @@ int SarReader::readArchive( struct ArchiveInfo *ai, int archive_type )
             ai->fi_list[i].original_length = getDecompressedFileLength( ai->fi_list[i].compression_type, ai->file_handle, ai->fi_list[i].offset );
         }
     }
+
+    mapArchive( ai );
     
     return 0;
 }
 
+void SarReader::mapArchive( ArchiveInfo *ai )
+{
+#ifdef USE_MMAP
+    // If this fails (e.g. no address space left for a huge archive),
+    // the files are simply read through file_handle as usual.
+    struct stat st;
+    if ( fstat( fileno( ai->file_handle ), &st ) != 0 || st.st_size == 0 ) return;
+
+    void *buf = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fileno( ai->file_handle ), 0 );
+    if ( buf == MAP_FAILED ) return;
+
+    ai->map_buf = (unsigned char*)buf;
+    ai->map_length = st.st_size;
+#endif
+}
+
+void SarReader::unmapArchive( ArchiveInfo *ai )
+{
+#ifdef USE_MMAP
+    if ( ai->map_buf ) munmap( ai->map_buf, ai->map_length );
+#endif
+    ai->map_buf = NULL;
+    ai->map_length = 0;
+}
+
 int SarReader::writeHeaderSub( ArchiveInfo *ai, FILE *fp, int archive_type )
 {
     unsigned int i, j;
@@ -218,6 +257,7 @@ int SarReader::close()
     
     for ( int i=0 ; i<num_of_sar_archives ; i++ ){
         if ( info->file_handle ){
+            unmapArchive( info );
             fclose( info->file_handle );
             delete[] info->file_name;
             delete[] info->fi_list;
@@ -226,6 +266,8 @@ int SarReader::close()
         info = info->next;
         delete last_archive_info;
     }
+    clearFileIndex();
+
     return 0;
 }
 
@@ -246,24 +288,97 @@ int SarReader::getNumFiles(){
     return num;
 }
 
-int SarReader::getIndexFromFile( ArchiveInfo *ai, const char *file_name )
+void SarReader::clearFileIndex()
+{
+    if ( file_index ) delete[] file_index;
+    file_index = NULL;
+    file_index_size = file_index_num = 0;
+}
+
+void SarReader::addFileIndex( ArchiveInfo *ai )
+{
+    unsigned int i, j;
+
+    // keep the table at most half full
+    if ( (file_index_num + ai->num_of_files) * 2 > file_index_size ){
+        FileIndexEntry *old_index = file_index;
+        unsigned int old_size = file_index_size;
+
+        if ( file_index_size == 0 ) file_index_size = 64;
+        while ( (file_index_num + ai->num_of_files) * 2 > file_index_size )
+            file_index_size <<= 1;
+        file_index = new FileIndexEntry[ file_index_size ];
+        for ( i=0 ; i<file_index_size ; i++ ) file_index[i].ai = NULL;
+
+        for ( i=0 ; i<old_size ; i++ ){
+            if ( old_index[i].ai == NULL ) continue;
+            j = old_index[i].hash & (file_index_size - 1);
+            while ( file_index[j].ai ) j = (j + 1) & (file_index_size - 1);
+            file_index[j] = old_index[i];
+        }
+        if ( old_index ) delete[] old_index;
+    }
+
+    // an entry already in the index (from an archive searched earlier,
+    // or earlier in this one) takes precedence, as with the linear search
+    for ( i=0 ; i<ai->num_of_files ; i++ ){
+        unsigned int hash = hashString( ai->fi_list[i].name );
+        j = hash & (file_index_size - 1);
+        while ( file_index[j].ai ){
+            if ( file_index[j].hash == hash &&
+                 !strcmp( file_index[j].ai->fi_list[ file_index[j].no ].name, ai->fi_list[i].name ) )
+                break;
+            j = (j + 1) & (file_index_size - 1);
+        }
+        if ( file_index[j].ai ) continue;
+
+        file_index[j].ai   = ai;
+        file_index[j].no   = i;
+        file_index[j].hash = hash;
+        file_index_num++;
+    }
+}
+
+struct SarReader::ArchiveInfo *SarReader::findFileIndex( const char *file_name, unsigned int &no )
 {
     unsigned int i, len;
+    char capital_buf[MAX_FILE_NAME_LENGTH+1];
+
+    if ( file_index_num == 0 ) return NULL;
 
     len = strlen( file_name );
     if ( len > MAX_FILE_NAME_LENGTH ) len = MAX_FILE_NAME_LENGTH;
-    memcpy( capital_name, file_name, len );
-    capital_name[ len ] = '\0';
+    memcpy( capital_buf, file_name, len );
+    capital_buf[ len ] = '\0';
 
     for ( i=0 ; i<len ; i++ ){
-        if ( 'a' <= capital_name[i] && capital_name[i] <= 'z' ) capital_name[i] += 'A' - 'a';
-        else if ( capital_name[i] == '/' ) capital_name[i] = '\\';
+        if ( 'a' <= capital_buf[i] && capital_buf[i] <= 'z' ) capital_buf[i] += 'A' - 'a';
+        else if ( capital_buf[i] == '/' ) capital_buf[i] = '\\';
     }
-    for ( i=0 ; i<ai->num_of_files ; i++ ){
-        if ( !strcmp( capital_name, ai->fi_list[i].name ) ) break;
+
+    unsigned int hash = hashString( capital_buf );
+    i = hash & (file_index_size - 1);
+    while ( file_index[i].ai ){
+        if ( file_index[i].hash == hash &&
+             !strcmp( file_index[i].ai->fi_list[ file_index[i].no ].name, capital_buf ) ){
+            no = file_index[i].no;
+            return file_index[i].ai;
+        }
+        i = (i + 1) & (file_index_size - 1);
     }
 
-    return i;
+    return NULL;
+}
+
+size_t SarReader::getFileLengthSub( ArchiveInfo *ai, unsigned int no, const char *file_name )
+{
+    if ( ai->fi_list[no].compression_type == NO_COMPRESSION ){
+        int type = getRegisteredCompressionType( file_name );
+        if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION )
+            return getDecompressedFileLength( type, ai->file_handle, ai->fi_list[no].offset );
+    }
+    
+    return ai->fi_list[no].original_length;
 }
 
 size_t SarReader::getFileLength( const char *file_name )
@@ -271,62 +386,81 @@ size_t SarReader::getFileLength( const char *file_name )
     size_t ret;
     if ( ( ret = DirectReader::getFileLength( file_name ) ) ) return ret;
 
-    ArchiveInfo *info = archive_info.next;
-    unsigned int j = 0;
-    for ( int i=0 ; i<num_of_sar_archives ; i++ ){
-        j = getIndexFromFile( info, file_name );
-        if ( j != info->num_of_files ) break;
-        info = info->next;
-    }
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
     if ( !info ) return 0;
     
-    if ( info->fi_list[j].compression_type == NO_COMPRESSION ){
-        int type = getRegisteredCompressionType( file_name );
-        if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION )
-            return getDecompressedFileLength( type, info->file_handle, info->fi_list[j].offset );
-    }
-    
-    return info->fi_list[j].original_length;
+    return getFileLengthSub( info, no, file_name );
 }
 
-size_t SarReader::getFileSub( ArchiveInfo *ai, const char *file_name, unsigned char *buf )
+size_t SarReader::getFileSub( ArchiveInfo *ai, unsigned int no, const char *file_name, unsigned char *buf )
 {
-    unsigned int i = getIndexFromFile( ai, file_name );
-    if ( i == ai->num_of_files ) return 0;
-
-    int type = ai->fi_list[i].compression_type;
+    int type = ai->fi_list[no].compression_type;
     if ( type == NO_COMPRESSION ) type = getRegisteredCompressionType( file_name );
 
-    if      ( type == NBZ_COMPRESSION ){
-        return decodeNBZ( ai->file_handle, ai->fi_list[i].offset, buf );
+    if ( type == NBZ_COMPRESSION || type == LZSS_COMPRESSION || type == SPB_COMPRESSION ){
+        DecodeContext ctx( ai->file_handle, ai->fi_list[no].offset, ai->map_buf, ai->map_length );
+        if      ( type == NBZ_COMPRESSION )
+            return decodeNBZ( ctx, buf );
+        else if ( type == LZSS_COMPRESSION )
+            return decodeLZSS( ctx, ai->fi_list[no].original_length, buf );
+        else
+            return decodeSPB( ctx, buf );
     }
-    else if ( type == LZSS_COMPRESSION ){
-        return decodeLZSS( ai, i, buf );
+
+    size_t ret;
+    if ( ai->map_buf && ai->fi_list[no].offset + ai->fi_list[no].length <= ai->map_length ){
+        ret = ai->fi_list[no].length;
+        memcpy( buf, ai->map_buf + ai->fi_list[no].offset, ret );
     }
-    else if ( type == SPB_COMPRESSION ){
-        return decodeSPB( ai->file_handle, ai->fi_list[i].offset, buf );
+    else{
+        ret = readAt( ai->file_handle, ai->fi_list[no].offset, buf, ai->fi_list[no].length );
     }
-
-    fseek( ai->file_handle, ai->fi_list[i].offset, SEEK_SET );
-    size_t ret = fread( buf, 1, ai->fi_list[i].length, ai->file_handle );
-    for (size_t j=0 ; j<ret ; j++) buf[j] = key_table[buf[j]];
+    if ( key_table_flag )
+        for (size_t j=0 ; j<ret ; j++) buf[j] = key_table[buf[j]];
     return ret;
 }
 
+const unsigned char *SarReader::getFileMapSub( ArchiveInfo *ai, unsigned int no, const char *file_name, size_t *length )
+{
+    if ( !ai->map_buf || key_table_flag ) return NULL;
+    if ( ai->fi_list[no].offset + ai->fi_list[no].length > ai->map_length ) return NULL;
+
+    int type = ai->fi_list[no].compression_type;
+    if ( type == NO_COMPRESSION ) type = getRegisteredCompressionType( file_name );
+    if ( type != NO_COMPRESSION ) return NULL;
+
+    *length = ai->fi_list[no].length;
+    return ai->map_buf + ai->fi_list[no].offset;
+}
+
 size_t SarReader::getFile( const char *file_name, unsigned char *buf, int *location )
 {
     size_t ret;
     if ( ( ret = DirectReader::getFile( file_name, buf, location ) ) ) return ret;
 
-    ArchiveInfo *info = archive_info.next;
-    size_t j = 0;
-    for ( int i=0 ; i<num_of_sar_archives ; i++ ){
-        if ( (j = getFileSub( info, file_name, buf )) > 0 ) break;
-        info = info->next;
-    }
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
+    if ( !info ) return 0;
+
     if ( location ) *location = ARCHIVE_TYPE_SAR;
     
-    return j;
+    return getFileSub( info, no, file_name, buf );
+}
+
+const unsigned char *SarReader::getFileMap( const char *file_name, size_t *length, int *location )
+{
+    // a loose file takes precedence, as in getFile()
+    if ( DirectReader::getFileLength( file_name ) ) return NULL;
+
+    unsigned int no;
+    ArchiveInfo *info = findFileIndex( file_name, no );
+    if ( !info ) return NULL;
+
+    const unsigned char *buf = getFileMapSub( info, no, file_name, length );
+    if ( buf && location ) *location = ARCHIVE_TYPE_SAR;
+
+    return buf;
 }
 
 struct SarReader::FileInfo SarReader::getFileByIndex( unsigned int index )
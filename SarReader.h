@@ -39,6 +39,7 @@ public:
     
     size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buf, int *location=NULL );
+    const unsigned char *getFileMap( const char *file_name, size_t *length, int *location=NULL );
     struct FileInfo getFileByIndex( unsigned int index );
 
     int writeHeader( FILE *fp );
@@ -49,9 +50,26 @@ protected:
     struct ArchiveInfo *root_archive_info, *last_archive_info;
     int num_of_sar_archives;
 
+    // hashed index over the files of all opened archives, in lookup order
+    struct FileIndexEntry{
+        ArchiveInfo *ai;
+        unsigned int no;
+        unsigned int hash;
+    } *file_index;
+    unsigned int file_index_size; // always a power of 2 (or 0)
+    unsigned int file_index_num;
+
+    void clearFileIndex();
+    void addFileIndex( ArchiveInfo *ai );
+    ArchiveInfo *findFileIndex( const char *file_name, unsigned int &no );
+
     int readArchive( ArchiveInfo *ai, int archive_type = ARCHIVE_TYPE_SAR );
-    int getIndexFromFile( ArchiveInfo *ai, const char *file_name );
-    size_t getFileSub( ArchiveInfo *ai, const char *file_name, unsigned char *buf );
+    size_t getFileLengthSub( ArchiveInfo *ai, unsigned int no, const char *file_name );
+    size_t getFileSub( ArchiveInfo *ai, unsigned int no, const char *file_name, unsigned char *buf );
+    const unsigned char *getFileMapSub( ArchiveInfo *ai, unsigned int no, const char *file_name, size_t *length );
+
+    void mapArchive( ArchiveInfo *ai );
+    void unmapArchive( ArchiveInfo *ai );
 
     int writeHeaderSub( ArchiveInfo *ai, FILE *fp, int archive_type = ARCHIVE_TYPE_SAR );
     size_t putFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer );
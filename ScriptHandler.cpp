@@ -27,6 +27,7 @@
 // Ogapee's 20090331 release source code.
 
 #include "ScriptHandler.h"
+#include "HashIndex.h"
 #ifdef MACOSX
 #include <Carbon/Carbon.h>
 #endif
@@ -39,6 +40,8 @@
 ScriptHandler::ScriptHandler()
 {
     num_of_labels = 0;
+    label_hash = NULL;
+    label_hash_size = 0;
     script_buffer = NULL;
     kidoku_buffer = NULL;
     log_info[LABEL_LOG].filename = "NScrllog.dat";
@@ -64,6 +67,12 @@ ScriptHandler::ScriptHandler()
     game_hash = 0;
 
     preferred_script = default_script = JAPANESE_SCRIPT;
+
+    for ( int i=0 ; i<ALIAS_HASH_SIZE ; i++ )
+        num_alias_hash[i] = str_alias_hash[i] = NULL;
+    num_alias_cache = NULL;
+    num_alias_cache_size = 0;
+    num_alias_cache_count = 0;
 }
 
 ScriptHandler::~ScriptHandler()
@@ -72,11 +81,13 @@ ScriptHandler::~ScriptHandler()
 
     if ( script_buffer ) delete[] script_buffer;
     if ( kidoku_buffer ) delete[] kidoku_buffer;
+    if ( label_hash ) delete[] label_hash;
 
     delete[] string_buffer;
     delete[] string_buffer;
     delete[] saved_string_buffer;
     delete[] variable_data;
+    if (num_alias_cache) delete[] num_alias_cache;
     
     if (game_identifier) delete[] game_identifier;
 }
@@ -124,6 +135,10 @@ void ScriptHandler::reset()
     last_str_alias = &root_str_alias;
     last_str_alias->next = NULL;
 
+    for ( int i=0 ; i<ALIAS_HASH_SIZE ; i++ )
+        num_alias_hash[i] = str_alias_hash[i] = NULL;
+    clearNumAliasCache();
+
     // reset misc. variables
     end_status = END_NONE;
     kidokuskip_flag = false;
@@ -652,24 +667,33 @@ char *ScriptHandler::getAddressByLine( int line )
     return addr;
 }
 
+// label_info is in the order of the script, so both start_address
+// and start_line are sorted; find the last label that starts at or
+// before the given place
 ScriptHandler::LabelInfo ScriptHandler::getLabelByAddress( char *address )
 {
-    int i;
-    for ( i=0 ; i<num_of_labels-1 ; i++ ){
-        if ( label_info[i+1].start_address > address )
-            return label_info[i];
+    int low = 1, high = num_of_labels;
+    while ( low < high ){
+        int mid = (low + high) / 2;
+        if ( label_info[mid].start_address > address )
+            high = mid;
+        else
+            low = mid + 1;
     }
-    return label_info[i];
+    return label_info[low-1];
 }
 
 ScriptHandler::LabelInfo ScriptHandler::getLabelByLine( int line )
 {
-    int i;
-    for ( i=0 ; i<num_of_labels-1 ; i++ ){
-        if ( label_info[i+1].start_line > line )
-            return label_info[i];
+    int low = 1, high = num_of_labels;
+    while ( low < high ){
+        int mid = (low + high) / 2;
+        if ( label_info[mid].start_line > line )
+            high = mid;
+        else
+            low = mid + 1;
     }
-    return label_info[i];
+    return label_info[low-1];
 }
 
 bool ScriptHandler::isName( const char *name )
@@ -1210,6 +1234,39 @@ int ScriptHandler::readScript( DirPaths *path )
     return labelScript();
 }
 
+// Lists every distinct character code of the script: two-byte SJIS
+// characters as lead byte << 8 | trail byte, the others as they are.
+// Commands and comments are included, which only costs a few more
+// entries.  The list is allocated with new[].
+int ScriptHandler::collectChars( unsigned short **list )
+{
+    unsigned char *used = new unsigned char[0x10000/8];
+    memset( used, 0, 0x10000/8 );
+
+    int num = 0;
+    unsigned char *buf = (unsigned char*)script_buffer;
+    unsigned char *end = buf + script_buffer_length;
+    while ( buf < end ){
+        unsigned short code = *buf++;
+        if ( IS_TWO_BYTE(code) && buf < end )
+            code = code << 8 | *buf++;
+        else if ( code < 0x20 )
+            continue;
+
+        if ( used[code>>3] & (1<<(code&7)) ) continue;
+        used[code>>3] |= 1<<(code&7);
+        num++;
+    }
+
+    *list = new unsigned short[num];
+    num = 0;
+    for ( int i=0 ; i<0x10000 ; i++ )
+        if ( used[i>>3] & (1<<(i&7)) ) (*list)[num++] = i;
+    delete[] used;
+
+    return num;
+}
+
 int ScriptHandler::labelScript()
 {
     int label_counter = -1;
@@ -1246,6 +1303,16 @@ int ScriptHandler::labelScript()
 
     label_info[num_of_labels].start_address = NULL;
 
+    // open-addressed index from label name to label_info; holds
+    // index+1, 0 if empty
+    label_hash_size = 256;
+    while ( label_hash_size < num_of_labels*2 ) label_hash_size *= 2;
+    if ( label_hash ) delete[] label_hash;
+    label_hash = new int[ label_hash_size ];
+    memset( label_hash, 0, sizeof(int)*label_hash_size );
+    for ( int i=0 ; i<num_of_labels ; i++ )
+        addHashIndex( label_hash, label_hash_size, label_info, &LabelInfo::name, i );
+
     return 0;
 }
 
@@ -1317,6 +1384,7 @@ void ScriptHandler::addNumAlias( const char *str, int no )
     Alias *p_num_alias = new Alias( str, no );
     last_num_alias->next = p_num_alias;
     last_num_alias = last_num_alias->next;
+    addAliasHash( num_alias_hash, p_num_alias );
 }
 
 void ScriptHandler::addStrAlias( const char *str1, const char *str2 )
@@ -1324,32 +1392,25 @@ void ScriptHandler::addStrAlias( const char *str1, const char *str2 )
     Alias *p_str_alias = new Alias( str1, str2 );
     last_str_alias->next = p_str_alias;
     last_str_alias = last_str_alias->next;
+    addAliasHash( str_alias_hash, p_str_alias );
 }
 
 bool ScriptHandler::findNumAlias( const char *str, int *value )
 {
-    Alias *p_num_alias = root_num_alias.next;
-    while( p_num_alias ){
-	if ( !strcmp( p_num_alias->alias, str ) ){
-	    *value = p_num_alias->num;
-	    return true;
-	}
-	p_num_alias = p_num_alias->next;
-    }
-    return false;
+    Alias *p_num_alias = findAliasHash( num_alias_hash, str );
+    if ( p_num_alias == NULL ) return false;
+
+    *value = p_num_alias->num;
+    return true;
 }
 
 bool ScriptHandler::findStrAlias( const char *str, char* buffer )
 {
-    Alias *p_str_alias = root_str_alias.next;
-    while( p_str_alias ){
-	if ( !strcmp( p_str_alias->alias, str ) ){
-	    strcpy( buffer, p_str_alias->str );
-	    return true;
-	}
-	p_str_alias = p_str_alias->next;
-    }
-    return false;
+    Alias *p_str_alias = findAliasHash( str_alias_hash, str );
+    if ( p_str_alias == NULL ) return false;
+
+    strcpy( buffer, p_str_alias->str );
+    return true;
 }
 
 void ScriptHandler::errorAndExit( const char *str )
@@ -1403,9 +1464,9 @@ int ScriptHandler::findLabel( const char *label )
         capital_label[i] = label[i];
         if ( 'A' <= capital_label[i] && capital_label[i] <= 'Z' ) capital_label[i] += 'a' - 'A';
     }
-    for ( i=0 ; i<num_of_labels ; i++ ){
-        if ( !strcmp( label_info[i].name, capital_label ) )
-            return i;
+    if ( label_hash ){
+        i = findHashIndex( label_hash, label_hash_size, label_info, &LabelInfo::name, capital_label );
+        if ( i >= 0 ) return i;
     }
 
     char *p = new char[ strlen(label) + 32 ];
@@ -1415,6 +1476,94 @@ int ScriptHandler::findLabel( const char *label )
     return -1; // dummy
 }
 
+static unsigned int hashAlias( const char *str )
+{
+    return hashString( str ) & (ALIAS_HASH_SIZE-1);
+}
+
+void ScriptHandler::addAliasHash( Alias **hash, Alias *alias )
+{
+    // an alias defined twice is still found by its first definition
+    if ( findAliasHash( hash, alias->alias ) ) return;
+
+    int i = hashAlias( alias->alias );
+    alias->hash_next = hash[i];
+    hash[i] = alias;
+}
+
+ScriptHandler::Alias *ScriptHandler::findAliasHash( Alias **hash, const char *str )
+{
+    Alias *alias = hash[ hashAlias( str ) ];
+    while ( alias && strcmp( alias->alias, str ) ) alias = alias->hash_next;
+
+    return alias;
+}
+
+static inline unsigned int hashOffset( int offset )
+{
+    unsigned int h = (unsigned int)offset * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+// A numalias name at a given place in the script always resolves
+// to the same number once found (aliases are only added in the
+// define section and never redefined), so parseInt() remembers it
+// by offset and skips lexing and looking up the name next time.
+bool ScriptHandler::findNumAliasCache( char **buf, int *value )
+{
+    if ( num_alias_cache_count == 0 || !isInScript( *buf ) ) return false;
+
+    int offset = *buf - script_buffer;
+    unsigned int i = hashOffset( offset ) & (num_alias_cache_size-1);
+    while ( num_alias_cache[i].offset >= 0 ){
+        if ( num_alias_cache[i].offset == offset ){
+            *buf += num_alias_cache[i].length;
+            *value = num_alias_cache[i].num;
+            return true;
+        }
+        i = (i+1) & (num_alias_cache_size-1);
+    }
+
+    return false;
+}
+
+void ScriptHandler::addNumAliasCache( char *buf, int length, int value )
+{
+    if ( !isInScript( buf ) ) return;
+
+    if ( num_alias_cache_count*2 >= num_alias_cache_size ){
+        NumAliasCache *tmp = num_alias_cache;
+        int tmp_size = num_alias_cache_size;
+
+        num_alias_cache_size = tmp_size ? tmp_size*2 : 1024;
+        num_alias_cache = new NumAliasCache[ num_alias_cache_size ];
+        for ( int i=0 ; i<num_alias_cache_size ; i++ ) num_alias_cache[i].offset = -1;
+        num_alias_cache_count = 0;
+
+        for ( int i=0 ; i<tmp_size ; i++ )
+            if ( tmp[i].offset >= 0 )
+                addNumAliasCache( script_buffer + tmp[i].offset, tmp[i].length, tmp[i].num );
+        if ( tmp ) delete[] tmp;
+    }
+
+    int offset = buf - script_buffer;
+    unsigned int i = hashOffset( offset ) & (num_alias_cache_size-1);
+    while ( num_alias_cache[i].offset >= 0 ){
+        if ( num_alias_cache[i].offset == offset ) return;
+        i = (i+1) & (num_alias_cache_size-1);
+    }
+    num_alias_cache[i].offset = offset;
+    num_alias_cache[i].length = length;
+    num_alias_cache[i].num = value;
+    num_alias_cache_count++;
+}
+
+void ScriptHandler::clearNumAliasCache()
+{
+    for ( int i=0 ; i<num_alias_cache_size ; i++ ) num_alias_cache[i].offset = -1;
+    num_alias_cache_count = 0;
+}
+
 char *ScriptHandler::checkComma( char *buf )
 {
     SKIP_SPACE( buf );
@@ -1566,6 +1715,9 @@ int ScriptHandler::parseInt( char **buf )
         current_variable.array = av;
         return *getArrayPtr( current_variable.var_no, current_variable.array, 0 );
     }
+    else if ( findNumAliasCache( buf, &ret ) ){
+        current_variable.type = VAR_INT | VAR_CONST;
+    }
     else{
         char ch, alias_buf[256];
         int alias_buf_len = 0, alias_no = 0;
@@ -1611,6 +1763,7 @@ int ScriptHandler::parseInt( char **buf )
                 *buf = buf_start;
                 return 0;
 	    }
+            addNumAliasCache( buf_start, *buf - buf_start, alias_no );
 	}
         current_variable.type = VAR_INT | VAR_CONST;
         ret = alias_no;
@@ -36,6 +36,7 @@
 #include "DirPaths.h"
 
 #define VARIABLE_RANGE 4096
+#define ALIAS_HASH_SIZE 256
 
 #define IS_TWO_BYTE(x) \
         ( ((x) & 0xe0) == 0xe0 || ((x) & 0xe0) == 0x80 )
@@ -145,6 +146,9 @@ public:
     // function for direct manipulation of script address 
     inline char *getCurrent(){ return current_script; };
     inline char *getNext(){ return next_script; };
+    inline bool isInScript( const char *pos ){
+        return pos >= script_buffer && pos < script_buffer + script_buffer_length; };
+    inline char *getScriptEnd(){ return script_buffer + script_buffer_length; };
     void setCurrent(char *pos);
     void pushCurrent( char *pos );
     void popCurrent();
@@ -155,6 +159,7 @@ public:
     char *getAddressByLine( int line );
     LabelInfo getLabelByAddress( char *address );
     LabelInfo getLabelByLine( int line );
+    int  collectChars( unsigned short **list );
 
     bool isName( const char *name );
     bool isText();
@@ -294,17 +299,20 @@ private:
     
     struct Alias{
         struct Alias *next;
+        struct Alias *hash_next;
         char *alias;
         int  num;
         char *str;
 
         Alias(){
             next = NULL;
+            hash_next = NULL;
             alias = NULL;
             str = NULL;
         };
         Alias( const char *name, int num ){
             next = NULL;
+            hash_next = NULL;
             alias = new char[ strlen(name) + 1];
             strcpy( alias, name );
             str = NULL;
@@ -312,6 +320,7 @@ private:
         };
         Alias( const char *name, const char *str ){
             next = NULL;
+            hash_next = NULL;
             alias = new char[ strlen(name) + 1];
             strcpy( alias, name );
             this->str = new char[ strlen(str) + 1];
@@ -323,7 +332,19 @@ private:
         };
     };
     
+    // numalias names resolved by parseInt(), by offset in the script
+    struct NumAliasCache{
+        int offset; // -1 if empty
+        int length;
+        int num;
+    };
+
     int findLabel( const char* label );
+    void addAliasHash( Alias **hash, Alias *alias );
+    Alias *findAliasHash( Alias **hash, const char *str );
+    bool findNumAliasCache( char **buf, int *value );
+    void addNumAliasCache( char *buf, int length, int value );
+    void clearNumAliasCache();
 
     char *checkComma( char *buf );
     void parseStr( char **buf );
@@ -345,6 +366,11 @@ private:
 
     Alias root_num_alias, *last_num_alias;
     Alias root_str_alias, *last_str_alias;
+    Alias *num_alias_hash[ALIAS_HASH_SIZE];
+    Alias *str_alias_hash[ALIAS_HASH_SIZE];
+    NumAliasCache *num_alias_cache;
+    int num_alias_cache_size;
+    int num_alias_cache_count;
     
     ArrayVariable *root_array_variable, *current_array_variable;
 
@@ -360,6 +386,8 @@ private:
 
     LabelInfo *label_info;
     int num_of_labels;
+    int *label_hash;
+    int label_hash_size;
 
     bool skip_enabled;
     bool kidokuskip_flag;
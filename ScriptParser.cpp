@@ -30,6 +30,7 @@
 // Ogapee's 20090331 release source code.
 
 #include "ScriptParser.h"
+#include "HashIndex.h"
 
 #define VERSION_STR1 "ONScripter"
 #define VERSION_STR2 "Copyright (C) 2001-2009 Studio O.G.A. All Rights Reserved."
@@ -171,8 +172,32 @@ static struct FuncLUT{
     {"", NULL}
 };
 
+// open-addressed index into func_lut; holds index+1, 0 if empty
+#define FUNC_LUT_HASH_SIZE 512
+static short func_lut_hash[FUNC_LUT_HASH_SIZE];
+static bool func_lut_hash_flag = false;
+
+static void initFuncLUTHash()
+{
+    if ( func_lut_hash_flag ) return;
+    func_lut_hash_flag = true;
+
+    for ( int i=0 ; func_lut[i].method ; i++ )
+        addHashIndex( func_lut_hash, FUNC_LUT_HASH_SIZE, func_lut, &FuncLUT::command, i );
+}
+
+static FuncList findFuncLUT( const char *cmd )
+{
+    int i = findHashIndex( func_lut_hash, FUNC_LUT_HASH_SIZE, func_lut, &FuncLUT::command, cmd );
+    if ( i >= 0 ) return func_lut[i].method;
+
+    return NULL;
+}
+
 ScriptParser::ScriptParser()
 {
+    initFuncLUTHash();
+
     debug_level = 0;
     srand( time(NULL) );
 
@@ -238,6 +263,7 @@ void ScriptParser::reset()
     }
     root_user_func.next = NULL;
     last_user_func = &root_user_func;
+    for ( int i=0 ; i<USER_FUNC_HASH_SIZE ; i++ ) user_func_hash[i] = NULL;
 
     // reset misc variables
     if ( nsa_path ){
@@ -464,30 +490,42 @@ int ScriptParser::parseLine()
 
     const char *cmd = script_h.getStringBuffer();
     if (cmd[0] != '_'){
-        UserFuncLUT *uf = root_user_func.next;
-        while( uf ){
-            if ( !strcmp( uf->command, cmd ) ){
-                gosubReal( cmd, script_h.getNext() );
-                return RET_CONTINUE;
-            }
-            uf = uf->next;
+        if ( findUserFunc( cmd ) ){
+            gosubReal( cmd, script_h.getNext() );
+            return RET_CONTINUE;
         }
     }
     else{
         cmd++;
     }
 
-    int lut_counter = 0;
-    while( func_lut[ lut_counter ].method ){
-        if ( !strcmp( func_lut[ lut_counter ].command, cmd ) ){
-            return (this->*func_lut[ lut_counter ].method)();
-        }
-        lut_counter++;
-    }
+    FuncList method = findFuncLUT( cmd );
+    if ( method ) return (this->*method)();
 
     return RET_NOMATCH;
 }
 
+void ScriptParser::addUserFunc( const char *cmd )
+{
+    last_user_func->next = new UserFuncLUT();
+    last_user_func = last_user_func->next;
+    setStr( &last_user_func->command, cmd );
+
+    // a name defined twice is still found by its first definition
+    if ( findUserFunc( cmd ) ) return;
+    int i = hashString( cmd ) & (USER_FUNC_HASH_SIZE-1);
+    last_user_func->hash_next = user_func_hash[i];
+    user_func_hash[i] = last_user_func;
+}
+
+ScriptParser::UserFuncLUT *ScriptParser::findUserFunc( const char *cmd )
+{
+    UserFuncLUT *uf = user_func_hash[hashString( cmd ) & (USER_FUNC_HASH_SIZE-1)];
+    while ( uf && strcmp( uf->command, cmd ) ) uf = uf->hash_next;
+
+    return uf;
+}
+
 void ScriptParser::deleteRMenuLink()
 {
     RMenuLink *link = root_rmenu_link.next;
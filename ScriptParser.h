@@ -58,6 +58,8 @@
 
 #define DEFAULT_FONT_SIZE 26
 
+#define USER_FUNC_HASH_SIZE 256
+
 #define DEFAULT_LOOKBACK_NAME0 "uoncur.bmp"
 #define DEFAULT_LOOKBACK_NAME1 "uoffcur.bmp"
 #define DEFAULT_LOOKBACK_NAME2 "doncur.bmp"
@@ -72,9 +74,7 @@ typedef unsigned char uchar3[3];
 struct OVInfo{
     SDL_AudioCVT cvt;
     int cvt_len;
-    int mult1;
-    int mult2;
-    unsigned char *buf;
+    const unsigned char *buf;
     long decoded_length;
 #if defined(USE_OGG_VORBIS)
     ogg_int64_t length;
@@ -89,6 +89,7 @@ public:
     typedef struct{
         OVInfo *ovi;
         int volume;
+        int gain; // Q15, at the end of the last buffer decoded
     } MusicStruct;
 
     ScriptParser();
@@ -201,15 +202,21 @@ public:
 protected:
     struct UserFuncLUT{
         struct UserFuncLUT *next;
+        struct UserFuncLUT *hash_next;
         char *command;
         UserFuncLUT(){
             next = NULL;
+            hash_next = NULL;
             command = NULL;
         };
         ~UserFuncLUT(){
             if (command) delete[] command;
         };
     } root_user_func, *last_user_func;
+    UserFuncLUT *user_func_hash[USER_FUNC_HASH_SIZE];
+
+    void addUserFunc( const char *cmd );
+    UserFuncLUT *findUserFunc( const char *cmd );
 
     struct NestInfo{
         enum { LABEL = 0,
@@ -1150,9 +1150,7 @@ int ScriptParser::defvoicevolCommand()
 
 int ScriptParser::defsubCommand()
 {
-    last_user_func->next = new UserFuncLUT();
-    setStr( &last_user_func->next->command, script_h.readName() );
-    last_user_func = last_user_func->next;
+    addUserFunc( script_h.readName() );
     
     return RET_CONTINUE;
 }
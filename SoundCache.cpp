@@ -0,0 +1,107 @@
+/* -*- C++ -*-
+ *
+ *  SoundCache.cpp - LRU cache of decoded sound effects
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SoundCache.h"
+#include "HashIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+SoundCache::SoundCache()
+    : LRUCache( "sound", "sounds", SOUND_CACHE_HASH_SIZE,
+                DEFAULT_SOUND_CACHE_SIZE*1024*1024, false )
+{
+}
+
+// Returns a new chunk with the samples of the sound, to be freed
+// with Mix_FreeChunk(), or NULL if the sound is not in the cache.
+Mix_Chunk *SoundCache::restore( const char *file_name, SDL_AudioSpec &spec, int *type )
+{
+    if ( budget == 0 ) return NULL;
+
+    Entry *entry = findEntry( file_name, spec );
+    if ( entry == NULL ){
+        num_misses++;
+        return NULL;
+    }
+
+    // Mix_FreeChunk() releases the samples with free()
+    Uint8 *abuf = (Uint8*)malloc( entry->size );
+    if ( abuf == NULL ) return NULL;
+    memcpy( abuf, entry->abuf, entry->size );
+    Mix_Chunk *chunk = Mix_QuickLoad_RAW( abuf, entry->size );
+    if ( chunk == NULL ){
+        free( abuf );
+        return NULL;
+    }
+    chunk->allocated = 1;
+    hit( entry );
+
+    *type = entry->type;
+
+    return chunk;
+}
+
+void SoundCache::store( const char *file_name, SDL_AudioSpec &spec, Mix_Chunk *chunk, int type )
+{
+    if ( chunk == NULL || !fits( chunk->alen ) ) return;
+
+    Entry *entry = findEntry( file_name, spec );
+    if ( entry ) removeEntry( entry );
+
+    entry = new Entry();
+    entry->hash = hashKey( file_name, spec );
+    entry->file_name = new char[ strlen(file_name) + 1 ];
+    strcpy( entry->file_name, file_name );
+    entry->freq = spec.freq;
+    entry->format = spec.format;
+    entry->channels = spec.channels;
+    entry->type = type;
+    entry->abuf = new Uint8[ chunk->alen ];
+    memcpy( entry->abuf, chunk->abuf, chunk->alen );
+    entry->size = chunk->alen;
+
+    insert( entry );
+}
+
+unsigned int SoundCache::hashKey( const char *file_name, SDL_AudioSpec &spec )
+{
+    unsigned int h = hashString( file_name );
+    h = hashMix( h, spec.freq );
+    h = hashMix( h, spec.format );
+    h = hashMix( h, spec.channels );
+
+    return h;
+}
+
+SoundCache::Entry *SoundCache::findEntry( const char *file_name, SDL_AudioSpec &spec )
+{
+    unsigned int hash = hashKey( file_name, spec );
+
+    Entry *entry = (Entry*)bucket( hash );
+    for ( ; entry ; entry = (Entry*)entry->hash_next ){
+        if ( entry->hash == hash &&
+             entry->freq == spec.freq &&
+             entry->format == spec.format &&
+             entry->channels == spec.channels &&
+             !strcmp( entry->file_name, file_name ) )
+            break;
+    }
+
+    return entry;
+}
@@ -0,0 +1,73 @@
+/* -*- C++ -*-
+ *
+ *  SoundCache.h - LRU cache of decoded sound effects
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SOUND_CACHE_H__
+#define __SOUND_CACHE_H__
+
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include "LRUCache.h"
+
+#define DEFAULT_SOUND_CACHE_SIZE 16 // in MB
+#define SOUND_CACHE_HASH_SIZE 64
+#define SOUND_CACHE_MAX_SOUND (256*1024) // about 1.5 s at 44.1 kHz stereo
+
+// Keeps the samples of the sounds played by playSound() as converted
+// by SDL_mixer, keyed by the file name and the spec the mixer was
+// opened with.  restore() hands out a fresh chunk with a copy of the
+// samples, since the caller frees its chunks when a channel stops.
+// Least recently used sounds are dropped once the total size
+// exceeds the budget.  Only short sounds are kept (see fits()):
+// anything longer is streamed, and would only push the clicks and
+// the other short effects out of the cache.
+class SoundCache : public LRUCache
+{
+public:
+    SoundCache();
+
+    bool fits( size_t bytes ){
+        return bytes > 0 && bytes <= SOUND_CACHE_MAX_SOUND && bytes <= budget / 8;
+    };
+
+    Mix_Chunk *restore( const char *file_name, SDL_AudioSpec &spec, int *type );
+    void store( const char *file_name, SDL_AudioSpec &spec, Mix_Chunk *chunk, int type );
+
+private:
+    struct Entry : LRUCache::Entry{
+        char *file_name;
+        int freq;
+        Uint16 format;
+        int channels;
+        int type; // what playSound() returns for the sound
+        Uint8 *abuf; // size bytes
+        Entry(){
+            file_name = NULL;
+            abuf = NULL;
+        };
+        ~Entry(){
+            if (file_name) delete[] file_name;
+            if (abuf) delete[] abuf;
+        };
+    };
+
+    unsigned int hashKey( const char *file_name, SDL_AudioSpec &spec );
+    Entry *findEntry( const char *file_name, SDL_AudioSpec &spec );
+};
+
+#endif // __SOUND_CACHE_H__
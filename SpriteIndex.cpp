@@ -0,0 +1,92 @@
+/* -*- C++ -*-
+ *
+ *  SpriteIndex.cpp - Sorted list of the sprites holding an image
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SpriteIndex.h"
+#include "AnimationInfo.h"
+#include <string.h>
+
+SpriteIndex::SpriteIndex()
+{
+    anim = NULL;
+    num = 0;
+    live = NULL;
+    num_live = 0;
+    listed = NULL;
+}
+
+SpriteIndex::~SpriteIndex()
+{
+    if ( live ) delete[] live;
+    if ( listed ) delete[] listed;
+}
+
+void SpriteIndex::open( AnimationInfo *anim, int num )
+{
+    if ( live ) delete[] live;
+    if ( listed ) delete[] listed;
+
+    this->anim = anim;
+    this->num = num;
+    live = new int[num];
+    listed = new bool[num];
+    num_live = 0;
+
+    for ( int i=0 ; i<num ; i++ ){
+        listed[i] = false;
+        anim[i].sprite_index = this;
+        anim[i].sprite_no = i;
+        if ( anim[i].image_surface ) add( i );
+    }
+}
+
+void SpriteIndex::add( int no )
+{
+    if ( no < 0 || no >= num || listed[no] ) return;
+
+    int i = lowerBound( no );
+    memmove( live+i+1, live+i, (num_live-i)*sizeof(int) );
+    live[i] = no;
+    num_live++;
+    listed[no] = true;
+}
+
+// A copy of an AnimationInfo shares the sprite number of the
+// original, so the entry is kept as long as the slot has an image.
+void SpriteIndex::remove( int no )
+{
+    if ( no < 0 || no >= num || !listed[no] ) return;
+    if ( anim[no].image_surface ) return;
+
+    int i = lowerBound( no );
+    memmove( live+i, live+i+1, (num_live-i-1)*sizeof(int) );
+    num_live--;
+    listed[no] = false;
+}
+
+int SpriteIndex::lowerBound( int no )
+{
+    int low = 0, high = num_live;
+    while ( low < high ){
+        int mid = (low + high) / 2;
+        if ( live[mid] < no ) low = mid + 1;
+        else                  high = mid;
+    }
+
+    return low;
+}
@@ -0,0 +1,55 @@
+/* -*- C++ -*-
+ *
+ *  SpriteIndex.h - Sorted list of the sprites holding an image
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SPRITE_INDEX_H__
+#define __SPRITE_INDEX_H__
+
+class AnimationInfo;
+
+// Keeps the numbers of the sprites of an array whose AnimationInfo
+// holds an image, in ascending order.  The AnimationInfo entries
+// report to it from allocImage() and deleteSurface(), so whatever
+// command loads or removes a sprite, the compositor and the
+// animation timer only need to visit the live ones instead of every
+// slot of the array.
+class SpriteIndex
+{
+public:
+    SpriteIndex();
+    ~SpriteIndex();
+
+    void open( AnimationInfo *anim, int num );
+
+    void add( int no );
+    void remove( int no );
+
+    int size(){ return num_live; };
+    int operator[]( int i ){ return live[i]; };
+    // position of the first sprite number not less than no
+    int lowerBound( int no );
+
+private:
+    AnimationInfo *anim;
+    int num;
+    int *live;
+    int num_live;
+    bool *listed;
+};
+
+#endif // __SPRITE_INDEX_H__
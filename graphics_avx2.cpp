@@ -0,0 +1,136 @@
+/* -*- C++ -*-
+ * 
+ *  graphics_avx2.cpp - graphics routines using X86 AVX2 cpu functionality
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Same as the crossfade routines in graphics_sse2.cpp, 8 pixels at a time
+
+#ifdef USE_X86_GFX
+
+#include <SDL.h>
+#include <immintrin.h>
+
+#include "graphics_common.h"
+
+
+// 256-bit unpacks work within each 128-bit half, so the low half of
+// the result holds pixels 0,1 (lo) or 2,3 (hi) and the high half
+// pixels 4,5 or 6,7; the weights are laid out the same way
+static inline __m256i crossfade8_AVX2(__m256i s1, __m256i s2, __m256i m1_lo, __m256i m2_lo,
+                                      __m256i m1_hi, __m256i m2_hi)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s1, zero), m1_lo),
+                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(s2, zero), m2_lo));
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s1, zero), m1_hi),
+                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(s2, zero), m2_hi));
+    lo = _mm256_srli_epi16(lo, 8);
+    hi = _mm256_srli_epi16(hi, 8);
+    return _mm256_and_si256(_mm256_packus_epi16(lo, hi), _mm256_set1_epi32(RGBMASK));
+}
+
+void imageFilterCrossfade_AVX2(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer, int alpha, int length)
+{
+    int n = length;
+    Uint32 mask2 = alpha;
+
+    __m256i m2 = _mm256_set1_epi16(mask2);
+    __m256i m1 = _mm256_set1_epi16(mask2 ^ 0xff);
+    while(n >= 8) {
+        __m256i s1 = _mm256_loadu_si256((__m256i*)src1_buffer);
+        __m256i s2 = _mm256_loadu_si256((__m256i*)src2_buffer);
+        _mm256_storeu_si256((__m256i*)dst_buffer, crossfade8_AVX2(s1, s2, m1, m2, m1, m2));
+
+        n -= 8; dst_buffer += 8; src1_buffer += 8; src2_buffer += 8;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_CROSSFADE();
+}
+
+void imageFilterCrossfadeMask_AVX2(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer,
+                                   Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length)
+{
+    int n = length;
+
+    // any mask_value beyond 0x7fff gives the same weights
+    __m128i mv = _mm_set1_epi16(mask_value > 0x7fff ? 0x7fff : mask_value);
+    __m128i ff = _mm_set1_epi16(0xff);
+    __m256i ff2 = _mm256_set1_epi16(0xff);
+    while(n >= 8) {
+        // weights of 8 pixels on 16-bit lanes
+        __m128i m = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)maskp));
+        __m128i m2;
+        if (threshold_flag)
+            m2 = _mm_and_si128(_mm_cmpgt_epi16(mv, m), ff);
+        else
+            m2 = _mm_min_epi16(_mm_subs_epu16(mv, m), ff);
+        // spread each weight over the 4 channels of its pixel
+        __m128i m03 = _mm_unpacklo_epi16(m2, m2);
+        __m128i m47 = _mm_unpackhi_epi16(m2, m2);
+        __m256i m2_lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(m03, m03)),
+                                                _mm_unpacklo_epi32(m47, m47), 1);
+        __m256i m2_hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpackhi_epi32(m03, m03)),
+                                                _mm_unpackhi_epi32(m47, m47), 1);
+        __m256i m1_lo = _mm256_xor_si256(m2_lo, ff2);
+        __m256i m1_hi = _mm256_xor_si256(m2_hi, ff2);
+
+        __m256i s1 = _mm256_loadu_si256((__m256i*)src1_buffer);
+        __m256i s2 = _mm256_loadu_si256((__m256i*)src2_buffer);
+        _mm256_storeu_si256((__m256i*)dst_buffer, crossfade8_AVX2(s1, s2, m1_lo, m2_lo, m1_hi, m2_hi));
+
+        n -= 8; dst_buffer += 8; src1_buffer += 8; src2_buffer += 8; maskp += 8;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_CROSSFADE_MASK();
+}
+
+// 8 coordinates are stepped at a time and the pixels fetched with one
+// gather; the lanes add i*dfx to fx, which is what BASIC_AFFINE_GATHER
+// gets by stepping i times
+void imageFilterAffineGather_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, int pitch,
+                                  int fx, int fy, int dfx, int dfy, int length)
+{
+    int n = length;
+
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(fx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfx)));
+    __m256i vy = _mm256_add_epi32(_mm256_set1_epi32(fy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dfy)));
+    __m256i step_x = _mm256_set1_epi32(dfx * 8);
+    __m256i step_y = _mm256_set1_epi32(dfy * 8);
+    __m256i vp = _mm256_set1_epi32(pitch);
+    while(n >= 8) {
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(vy, 16), vp),
+                                         _mm256_srai_epi32(vx, 16));
+        _mm256_storeu_si256((__m256i*)dst_buffer,
+                            _mm256_i32gather_epi32((const int*)src_buffer, index, 4));
+        vx = _mm256_add_epi32(vx, step_x);
+        vy = _mm256_add_epi32(vy, step_y);
+
+        n -= 8; dst_buffer += 8;
+        fx += dfx * 8; fy += dfy * 8;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_AFFINE_GATHER();
+}
+
+#endif
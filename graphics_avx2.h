@@ -0,0 +1,28 @@
+/* -*- C++ -*-
+ * 
+ *  graphics_avx2.h - graphics routines using X86 AVX2 cpu functionality
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef USE_X86_GFX
+
+void imageFilterCrossfade_AVX2(Uint32 *dst, Uint32 *src1, Uint32 *src2, int alpha, int length);
+void imageFilterCrossfadeMask_AVX2(Uint32 *dst, Uint32 *src1, Uint32 *src2,
+                                   Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length);
+void imageFilterAffineGather_AVX2(Uint32 *dst, Uint32 *src, int pitch,
+                                  int fx, int fy, int dfx, int dfy, int length);
+
+#endif
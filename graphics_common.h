@@ -120,6 +120,47 @@
     } \
 }
 
+// crossfade used by ONScripterLabel::alphaBlend; mask2 is the weight
+// of src2 (0-255), the alpha channel of dst is cleared
+#define CROSSFADE_PIXEL(){\
+    Uint32 mask1 = mask2 ^ 0xff;\
+    Uint32 mask_rb = (((*src1_buffer & 0xff00ff) * mask1 +\
+                       (*src2_buffer & 0xff00ff) * mask2) >> 8) & 0xff00ff;\
+    Uint32 mask_g = (((*src1_buffer & 0x00ff00) * mask1 +\
+                      (*src2_buffer & 0x00ff00) * mask2) >> 8) & 0x00ff00;\
+    *dst_buffer = mask_rb | mask_g;\
+}
+
+// weight of src2 for a mask pixel; a fade mask only switches between
+// src1 and src2, a crossfade mask saturates at 255
+#define MASK_TO_ALPHA(mask) \
+    ((mask_value > (mask)) ?\
+     ((threshold_flag || mask_value - (mask) > 0xff) ? 0xff : mask_value - (mask)) : 0)
+
+#define BASIC_CROSSFADE(){\
+    while(--n > 0) {  \
+        CROSSFADE_PIXEL();  \
+        ++dst_buffer, ++src1_buffer, ++src2_buffer;  \
+    } \
+}
+
+#define BASIC_CROSSFADE_MASK(){\
+    while(--n > 0) {  \
+        Uint32 mask2 = MASK_TO_ALPHA(*maskp);  \
+        CROSSFADE_PIXEL();  \
+        ++dst_buffer, ++src1_buffer, ++src2_buffer, ++maskp;  \
+    } \
+}
+
+// pixels of an affine span, read at (fx, fy) in 16.16 fixed point and
+// stepped by (dfx, dfy); used by AnimationInfo::blendOnSurface2
+#define BASIC_AFFINE_GATHER(){\
+    while(--n > 0) {  \
+        *dst_buffer++ = src_buffer[(fy >> 16) * pitch + (fx >> 16)];  \
+        fx += dfx, fy += dfy;  \
+    } \
+}
+
 
 #define MEAN_PIXEL(){\
     int result = ((int)(*src1) + (int)(*src2)) / 2;  \
@@ -25,6 +25,7 @@
 
 #include <SDL.h>
 #include <emmintrin.h>
+#include <string.h>
 #include <math.h>
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -176,4 +177,77 @@ void imageFilterBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap
     BASIC_BLEND();
 }
 
+// dst = (src1 * (255-mask2) + src2 * mask2) >> 8 for each channel,
+// computed on 16-bit lanes; the sums never exceed 255*255
+static inline __m128i crossfade4_SSE2(__m128i s1, __m128i s2, __m128i m1_lo, __m128i m2_lo,
+                                      __m128i m1_hi, __m128i m2_hi)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s1, zero), m1_lo),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(s2, zero), m2_lo));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s1, zero), m1_hi),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(s2, zero), m2_hi));
+    lo = _mm_srli_epi16(lo, 8);
+    hi = _mm_srli_epi16(hi, 8);
+    return _mm_and_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(RGBMASK));
+}
+
+void imageFilterCrossfade_SSE2(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer, int alpha, int length)
+{
+    int n = length;
+    Uint32 mask2 = alpha;
+
+    __m128i m2 = _mm_set1_epi16(mask2);
+    __m128i m1 = _mm_set1_epi16(mask2 ^ 0xff);
+    while(n >= 4) {
+        __m128i s1 = _mm_loadu_si128((__m128i*)src1_buffer);
+        __m128i s2 = _mm_loadu_si128((__m128i*)src2_buffer);
+        _mm_storeu_si128((__m128i*)dst_buffer, crossfade4_SSE2(s1, s2, m1, m2, m1, m2));
+
+        n -= 4; dst_buffer += 4; src1_buffer += 4; src2_buffer += 4;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_CROSSFADE();
+}
+
+void imageFilterCrossfadeMask_SSE2(Uint32 *dst_buffer, Uint32 *src1_buffer, Uint32 *src2_buffer,
+                                   Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length)
+{
+    int n = length;
+
+    // any mask_value beyond 0x7fff gives the same weights
+    __m128i mv = _mm_set1_epi16(mask_value > 0x7fff ? 0x7fff : mask_value);
+    __m128i ff = _mm_set1_epi16(0xff);
+    __m128i zero = _mm_setzero_si128();
+    while(n >= 4) {
+        // weights of 4 pixels on 16-bit lanes
+        int m4;
+        memcpy(&m4, maskp, 4);
+        __m128i m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(m4), zero);
+        __m128i m2;
+        if (threshold_flag)
+            m2 = _mm_and_si128(_mm_cmpgt_epi16(mv, m), ff);
+        else
+            m2 = _mm_min_epi16(_mm_subs_epu16(mv, m), ff);
+        // spread each weight over the 4 channels of its pixel
+        m2 = _mm_unpacklo_epi16(m2, m2);
+        __m128i m2_lo = _mm_unpacklo_epi32(m2, m2);
+        __m128i m2_hi = _mm_unpackhi_epi32(m2, m2);
+        __m128i m1_lo = _mm_xor_si128(m2_lo, ff);
+        __m128i m1_hi = _mm_xor_si128(m2_hi, ff);
+
+        __m128i s1 = _mm_loadu_si128((__m128i*)src1_buffer);
+        __m128i s2 = _mm_loadu_si128((__m128i*)src2_buffer);
+        _mm_storeu_si128((__m128i*)dst_buffer, crossfade4_SSE2(s1, s2, m1_lo, m2_lo, m1_hi, m2_hi));
+
+        n -= 4; dst_buffer += 4; src1_buffer += 4; src2_buffer += 4; maskp += 4;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_CROSSFADE_MASK();
+}
+
 #endif
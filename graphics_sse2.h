@@ -25,5 +25,8 @@ void imageFilterMean_SSE2(unsigned char *src1, unsigned char *src2, unsigned cha
 void imageFilterAddTo_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterSubFrom_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterBlend_SSE2(Uint32 *dst, Uint32 *src, Uint8 *alphap, int alpha, int length);
+void imageFilterCrossfade_SSE2(Uint32 *dst, Uint32 *src1, Uint32 *src2, int alpha, int length);
+void imageFilterCrossfadeMask_SSE2(Uint32 *dst, Uint32 *src1, Uint32 *src2,
+                                   Uint8 *maskp, Uint32 mask_value, bool threshold_flag, int length);
 
 #endif
@@ -61,6 +61,12 @@ static void optionHelp()
     printf( "      --disable-rescale\tdo not rescale the images in the archives when compiled with -DPDA\n");
     printf( "      --edit\t\tenable editing the volumes and the variables when 'z' is pressed\n");
     printf( "      --key-exe file\tset a file (*.EXE) that includes a key table\n");
+    printf( "      --prefetch-threads num\tdecode upcoming images with num background threads (default: %d, 0 to disable)\n", DEFAULT_PREFETCH_THREADS);
+    printf( "      --image-cache-size mb\tkeep up to mb megabytes of loaded images (default: %d, 0 to disable)\n", DEFAULT_IMAGE_CACHE_SIZE);
+    printf( "      --glyph-cache-size kb\tkeep up to kb kilobytes of rendered glyphs (default: %d)\n", DEFAULT_GLYPH_CACHE_SIZE);
+    printf( "      --sound-cache-size mb\tkeep up to mb megabytes of decoded sound effects (default: %d, 0 to disable)\n", DEFAULT_SOUND_CACHE_SIZE);
+    printf( "      --preload-glyphs\trender the characters of the script in the text font before it starts\n");
+    printf( "      --compositor-threads num\tdraw the screen in bands with num additional threads (default: 0)\n");
     printf( "      --debug\t\tgenerate runtime debugging output\n");
     printf( "  -h, --help\t\tshow this help and exit\n");
     printf( "  -v, --version\t\tshow the version information and exit\n");
@@ -200,6 +206,34 @@ int main( int argc, char **argv )
                 argv++;
                 ons.setKeyEXE(argv[0]);
             }
+            else if ( !strcmp( argv[0]+1, "-prefetch-threads" ) ){
+                argc--;
+                argv++;
+                ons.setPrefetchThreads(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-image-cache-size" ) ){
+                argc--;
+                argv++;
+                ons.setImageCacheSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-glyph-cache-size" ) ){
+                argc--;
+                argv++;
+                ons.setGlyphCacheSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-sound-cache-size" ) ){
+                argc--;
+                argv++;
+                ons.setSoundCacheSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-preload-glyphs" ) ){
+                ons.setPreloadGlyphs();
+            }
+            else if ( !strcmp( argv[0]+1, "-compositor-threads" ) ){
+                argc--;
+                argv++;
+                ons.setCompositorThreads(atoi(argv[0]));
+            }
 #ifdef RCA_SCALE
             else if ( !strcmp( argv[0]+1, "-widescreen" ) ){
                 ons.setWidescreen();
@@ -0,0 +1,232 @@
+/* -*- C++ -*-
+ *
+ *  affinebench.cpp - Benchmark of the rotated and scaled sprite drawing
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Usage: affinebench [rounds]
+//
+// Draws a 320x240 sprite with random colours and alpha onto an 800x600
+// surface through AnimationInfo::blendOnSurface2, for every rotation
+// angle, scale and blending mode below, and times it against the
+// divide-per-pixel loop it had before.  Each result has to be byte for
+// byte what that loop gives.  The C, SSE2 and AVX2 paths are run in
+// turn as far as the CPU has them.
+
+#include "AnimationInfo.h"
+#include "graphics_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SCREEN_W 800
+#define SCREEN_H 600
+#define SPRITE_W 320
+#define SPRITE_H 240
+
+static const int angles[] = { 0, 10, 45, 90, 135, 200, 333 };
+static const int scales[] = { 25, 100, 170, 300, -100 };
+#define NUM_ANGLES (int)(sizeof(angles) / sizeof(angles[0]))
+#define NUM_SCALES (int)(sizeof(scales) / sizeof(scales[0]))
+
+struct Mode{
+    const char *name;
+    int blending_mode, trans_mode, alpha;
+};
+static const Mode modes[] = {
+    { "normal", AnimationInfo::BLEND_NORMAL, AnimationInfo::TRANS_ALPHA, 200 },
+    { "copy",   AnimationInfo::BLEND_NORMAL, AnimationInfo::TRANS_COPY,  256 },
+    { "add",    AnimationInfo::BLEND_ADD,    AnimationInfo::TRANS_ALPHA, 256 },
+    { "sub",    AnimationInfo::BLEND_SUB,    AnimationInfo::TRANS_ALPHA, 256 },
+};
+#define NUM_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+// blendOnSurface2 as it was before the span clipping and the gather
+static void referenceBlend( AnimationInfo *anim, SDL_Surface *dst_surface,
+                            int dst_x, int dst_y, SDL_Rect &clip, int alpha )
+{
+    int i, x, y;
+
+    int min_xy[2]={anim->bounding_rect.x, anim->bounding_rect.y};
+    int max_xy[2]={anim->bounding_rect.x+anim->bounding_rect.w-1,
+                   anim->bounding_rect.y+anim->bounding_rect.h-1};
+
+    if (max_xy[0] < clip.x) return;
+    if (max_xy[0] >= clip.x+clip.w) max_xy[0] = clip.x+clip.w - 1;
+    if (min_xy[0] >= clip.x+clip.w) return;
+    if (min_xy[0] < clip.x) min_xy[0] = clip.x;
+    if (max_xy[1] < clip.y) return;
+    if (max_xy[1] >= clip.y+clip.h) max_xy[1] = clip.y+clip.h - 1;
+    if (min_xy[1] >= clip.y+clip.h) return;
+    if (min_xy[1] < clip.y) min_xy[1] = clip.y;
+
+    SDL_Surface *image_surface = anim->image_surface;
+    int total_width = image_surface->pitch / 4;
+    for (y=min_xy[1] ; y<= max_xy[1] ; y++){
+        int raster_min = min_xy[0], raster_max = max_xy[0];
+        for (i=0 ; i<4 ; i++){
+            int (*corner_xy)[2] = anim->corner_xy;
+            if (corner_xy[i][1] == corner_xy[(i+1)%4][1]) continue;
+            x = (corner_xy[(i+1)%4][0] - corner_xy[i][0])*(y-corner_xy[i][1])/
+                (corner_xy[(i+1)%4][1] - corner_xy[i][1]) + corner_xy[i][0];
+            if (corner_xy[(i+1)%4][1] - corner_xy[i][1] > 0){
+                if (raster_min < x) raster_min = x;
+            }
+            else{
+                if (raster_max > x) raster_max = x;
+            }
+        }
+
+        Uint32 *dst_buffer = (Uint32 *)dst_surface->pixels + dst_surface->w * y + raster_min;
+
+        int x_offset = anim->inv_mat[0][1] * (y-dst_y) / 1000 + anim->pos.w/2;
+        int y_offset = anim->inv_mat[1][1] * (y-dst_y) / 1000 + anim->pos.h/2;
+        for (x=raster_min-dst_x ; x<=raster_max-dst_x ; x++, dst_buffer++){
+            int x2 = anim->inv_mat[0][0] * x / 1000 + x_offset;
+            int y2 = anim->inv_mat[1][0] * x / 1000 + y_offset;
+
+            if (x2 < 0 || x2 >= anim->pos.w ||
+                y2 < 0 || y2 >= anim->pos.h) continue;
+
+            Uint32 *src_buffer = (Uint32 *)image_surface->pixels + total_width * y2 + x2 +
+                anim->pos.w*anim->current_cell;
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+            unsigned char *alphap = (unsigned char *)src_buffer + 3;
+#else
+            unsigned char *alphap = (unsigned char *)src_buffer;
+#endif
+            if (anim->blending_mode == AnimationInfo::BLEND_NORMAL) {
+                if ((anim->trans_mode == AnimationInfo::TRANS_COPY) && (alpha == 256)) {
+                    SET_PIXEL(*src_buffer, 0xff);
+                } else {
+                    BLEND_PIXEL();
+                }
+            } else if (anim->blending_mode == AnimationInfo::BLEND_ADD) {
+                ADDBLEND_PIXEL();
+            } else if (anim->blending_mode == AnimationInfo::BLEND_SUB) {
+                SUBBLEND_PIXEL();
+            }
+        }
+    }
+}
+
+static double now()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void fillRandom( SDL_Surface *surface, unsigned int seed, Uint32 opaque )
+{
+    srand( seed );
+    for (int y=0 ; y<surface->h ; y++){
+        Uint32 *p = (Uint32 *)((Uint8 *)surface->pixels + surface->pitch * y);
+        for (int x=0 ; x<surface->w ; x++)
+            p[x] = ((Uint32)(rand() & 0xffff) << 16) | (rand() & 0xffff) | opaque;
+    }
+}
+
+int main( int argc, char **argv )
+{
+#ifdef BPP16
+    printf( "affinebench only covers the 32-bit drawing\n" );
+    return 0;
+#endif
+    int rounds = 20;
+    if ( argc > 1 ) rounds = atoi( argv[1] );
+    if ( rounds <= 0 ) rounds = 1;
+
+    unsigned int paths[3], num_paths = 0;
+    const char *path_names[3];
+    paths[num_paths] = AnimationInfo::CPUF_NONE;
+    path_names[num_paths++] = "C";
+#if defined(USE_X86_GFX) && defined(__GNUC__)
+    if (__builtin_cpu_supports( "sse2" )){
+        paths[num_paths] = AnimationInfo::CPUF_X86_SSE2;
+        path_names[num_paths++] = "SSE2";
+        if (__builtin_cpu_supports( "avx2" )){
+            paths[num_paths] = AnimationInfo::CPUF_X86_SSE2 | AnimationInfo::CPUF_X86_AVX2;
+            path_names[num_paths++] = "AVX2";
+        }
+    }
+#endif
+
+    SDL_Surface *ref_surface = AnimationInfo::allocSurface( SCREEN_W, SCREEN_H );
+    SDL_Surface *dst_surface = AnimationInfo::allocSurface( SCREEN_W, SCREEN_H );
+    SDL_Rect clip = { 0, 0, SCREEN_W, SCREEN_H };
+
+    AnimationInfo anim;
+    anim.num_of_cells = 1;
+    anim.allocImage( SPRITE_W, SPRITE_H );
+    anim.pos.x = SCREEN_W / 2;
+    anim.pos.y = SCREEN_H / 2;
+
+    int num_cases = 0, num_mismatches = 0;
+    printf( "%-8s %10s", "mode", "reference" );
+    for (unsigned int p=0 ; p<num_paths ; p++) printf( " %10s", path_names[p] );
+    printf( "   (ms for all angles and scales)\n" );
+
+    for (int m=0 ; m<NUM_MODES ; m++){
+        const Mode &mode = modes[m];
+        anim.blending_mode = mode.blending_mode;
+        anim.trans_mode = mode.trans_mode;
+        double ref_time = 0, new_time[3] = { 0, 0, 0 };
+
+        for (int a=0 ; a<NUM_ANGLES ; a++)
+            for (int s=0 ; s<NUM_SCALES ; s++){
+                anim.rot = angles[a];
+                anim.scale_x = anim.scale_y = scales[s];
+                anim.calcAffineMatrix();
+
+                // setupImage() leaves the alpha of a copied image at 0xff
+                Uint32 opaque = (mode.trans_mode == AnimationInfo::TRANS_COPY) ? AMASK : 0;
+                fillRandom( ref_surface, 2, 0 );
+                fillRandom( anim.image_surface, 1, opaque );
+                double t = now();
+                for (int r=0 ; r<rounds ; r++)
+                    referenceBlend( &anim, ref_surface, anim.pos.x, anim.pos.y, clip, mode.alpha );
+                ref_time += now() - t;
+
+                for (unsigned int p=0 ; p<num_paths ; p++){
+                    AnimationInfo::setCpufuncs( paths[p] );
+                    fillRandom( dst_surface, 2, 0 );
+                    fillRandom( anim.image_surface, 1, opaque );
+                    t = now();
+                    for (int r=0 ; r<rounds ; r++)
+                        anim.blendOnSurface2( dst_surface, anim.pos.x, anim.pos.y, clip, mode.alpha );
+                    new_time[p] += now() - t;
+
+                    num_cases++;
+                    if (memcmp( ref_surface->pixels, dst_surface->pixels,
+                                SCREEN_W * SCREEN_H * 4 ) != 0){
+                        printf( "mismatch: %s, angle %d, scale %d, %s\n",
+                                mode.name, angles[a], scales[s], path_names[p] );
+                        num_mismatches++;
+                    }
+                }
+            }
+
+        printf( "%-8s %10.1f", mode.name, ref_time * 1000 / rounds );
+        for (unsigned int p=0 ; p<num_paths ; p++) printf( " %10.1f", new_time[p] * 1000 / rounds );
+        printf( "\n" );
+    }
+
+    SDL_FreeSurface( ref_surface );
+    SDL_FreeSurface( dst_surface );
+
+    printf( "%d/%d cases match\n", num_cases - num_mismatches, num_cases );
+    return (num_mismatches > 0) ? 1 : 0;
+}
@@ -0,0 +1,643 @@
+/* -*- C++ -*-
+ *
+ *  decodertest.cpp - Regression test for the SPB and LZSS decoders
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Usage: decodertest file.bmp ...
+//
+// Each 24-bit BMP given is compressed to an SPB entry, and the whole
+// file to an LZSS entry, along with a few synthetic images that go
+// through every SPB code.  The entries are written to an NSA archive,
+// once as is and once through a key table, and read back with
+// NsaReader.  The result has to be byte for byte what the original
+// bit-at-a-time decoder below gives for the same entry.
+
+#include "NsaReader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_ARCHIVE "decodertest.nsa"
+#define MAX_ENTRIES 64
+
+#define EI 8
+#define EJ 4
+#define P   1
+#define N (1 << EI)
+#define F ((1 << EJ) + P)
+
+/* ---------------------------------------- */
+// The decoders as they were before the word-at-a-time rewrite,
+// reading from memory instead of a FILE.
+
+class ReferenceDecoder
+{
+public:
+    ReferenceDecoder( const unsigned char *key_table, const unsigned char *data, size_t length ){
+        this->key_table = key_table;
+        p = data;
+        end = data + length;
+        getbit_mask = 0;
+        getbit_buf = 0;
+    };
+
+    int getbit( int n ){
+        int i, x = 0;
+
+        for ( i=0 ; i<n ; i++ ){
+            if ( getbit_mask == 0 ){
+                if ( p == end ) return EOF;
+                getbit_buf = key_table[*p++];
+                getbit_mask = 128;
+            }
+            x <<= 1;
+            if ( getbit_buf & getbit_mask ) x++;
+            getbit_mask >>= 1;
+        }
+        return x;
+    };
+
+    size_t decodeSPB( unsigned char *buf ){
+        unsigned int count;
+        unsigned char *pbuf, *psbuf;
+        size_t i, j, k;
+        int c, n, m;
+
+        size_t width  = key_table[p[0]] << 8 | key_table[p[1]];
+        size_t height = key_table[p[2]] << 8 | key_table[p[3]];
+        p += 4;
+
+        size_t width_pad  = (4 - width * 3 % 4) % 4;
+
+        size_t total_size = (width * 3 + width_pad) * height + 54;
+
+        memset( buf, 0, 54 );
+        buf[0] = 'B'; buf[1] = 'M';
+        buf[2] = total_size & 0xff;
+        buf[3] = (total_size >>  8) & 0xff;
+        buf[4] = (total_size >> 16) & 0xff;
+        buf[5] = (total_size >> 24) & 0xff;
+        buf[10] = 54;
+        buf[14] = 40;
+        buf[18] = width & 0xff;
+        buf[19] = (width >> 8)  & 0xff;
+        buf[22] = height & 0xff;
+        buf[23] = (height >> 8)  & 0xff;
+        buf[26] = 1;
+        buf[28] = 24;
+        buf[34] = total_size - 54;
+
+        buf += 54;
+
+        unsigned char *decomp_buffer = new unsigned char[width*height+4];
+
+        for ( i=0 ; i<3 ; i++ ){
+            count = 0;
+            decomp_buffer[count++] = c = getbit( 8 );
+            while ( count < (unsigned)(width * height) ){
+                n = getbit( 3 );
+                if ( n == 0 ){
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                    continue;
+                }
+                else if ( n == 7 ){
+                    m = getbit( 1 ) + 1;
+                }
+                else{
+                    m = n + 2;
+                }
+
+                for ( j=0 ; j<4 ; j++ ){
+                    if ( m == 8 ){
+                        c = getbit( 8 );
+                    }
+                    else{
+                        k = getbit( m );
+                        if ( k & 1 ) c += (k>>1) + 1;
+                        else         c -= (k>>1);
+                    }
+                    decomp_buffer[count++] = c;
+                }
+            }
+
+            pbuf  = buf + (width * 3 + width_pad)*(height-1) + i;
+            psbuf = decomp_buffer;
+
+            for ( j=0 ; j<height ; j++ ){
+                if ( j & 1 ){
+                    for ( k=0 ; k<width ; k++, pbuf -= 3 ) *pbuf = *psbuf++;
+                    pbuf -= width * 3 + width_pad - 3;
+                }
+                else{
+                    for ( k=0 ; k<width ; k++, pbuf += 3 ) *pbuf = *psbuf++;
+                    pbuf -= width * 3 + width_pad + 3;
+                }
+            }
+        }
+        delete[] decomp_buffer;
+
+        return total_size;
+    };
+
+    size_t decodeLZSS( size_t original_length, unsigned char *buf ){
+        unsigned int count = 0;
+        int i, j, k, r, c;
+        unsigned char decomp_buffer[N];
+
+        memset( decomp_buffer, 0, N );
+        r = N - F;
+
+        while ( count < original_length ){
+            if ( getbit( 1 ) ) {
+                if ((c = getbit( 8 )) == EOF) break;
+                buf[ count++ ] = c;
+                decomp_buffer[r++] = c;  r &= (N - 1);
+            } else {
+                if ((i = getbit( EI )) == EOF) break;
+                if ((j = getbit( EJ )) == EOF) break;
+                for (k = 0; k <= j + 1  ; k++) {
+                    c = decomp_buffer[(i + k) & (N - 1)];
+                    buf[ count++ ] = c;
+                    decomp_buffer[r++] = c;  r &= (N - 1);
+                }
+            }
+        }
+
+        return count;
+    };
+
+private:
+    const unsigned char *key_table;
+    const unsigned char *p, *end;
+    int getbit_mask;
+    int getbit_buf;
+};
+
+/* ---------------------------------------- */
+// Encoders for the test data
+
+class BitWriter
+{
+public:
+    BitWriter(){
+        size = 1024;
+        buf = new unsigned char[size];
+        len = 0;
+        bits = 0;
+        num_bits = 0;
+    };
+    ~BitWriter(){
+        delete[] buf;
+    };
+
+    void put( int value, int n ){
+        for ( int i=n-1 ; i>=0 ; i-- ){
+            bits = bits << 1 | ((value >> i) & 1);
+            if ( ++num_bits == 8 ) flushByte();
+        }
+    };
+    // pads the last byte with zeros; the caller delete[]s the result
+    unsigned char *take( size_t *length ){
+        if ( num_bits > 0 ){
+            bits <<= 8 - num_bits;
+            flushByte();
+        }
+        unsigned char *ret = buf;
+        *length = len;
+        buf = NULL;
+        return ret;
+    };
+
+private:
+    void flushByte(){
+        if ( len == size ){
+            unsigned char *tmp = new unsigned char[size*2];
+            memcpy( tmp, buf, size );
+            delete[] buf;
+            buf = tmp;
+            size *= 2;
+        }
+        buf[len++] = bits;
+        bits = 0;
+        num_bits = 0;
+    };
+
+    unsigned char *buf;
+    size_t size, len;
+    int bits, num_bits;
+};
+
+// plane[i] holds the pixels of channel i in the order decodeSPB()
+// stores them: rows from the top, every other row right to left
+static unsigned char *encodeSPB( int width, int height, unsigned char **plane, size_t *length )
+{
+    BitWriter bw;
+    bw.put( width, 16 );
+    bw.put( height, 16 );
+
+    int num = width * height;
+    unsigned char *data = new unsigned char[num+4];
+    for ( int i=0 ; i<3 ; i++ ){
+        memcpy( data, plane[i], num );
+        memset( data+num, 0, 4 );
+
+        int c = data[0];
+        bw.put( c, 8 );
+        for ( int count=1 ; count<num ; count+=4 ){
+            unsigned char *g = data + count;
+            if ( g[0] == (c & 0xff) && g[1] == (c & 0xff) &&
+                 g[2] == (c & 0xff) && g[3] == (c & 0xff) ){
+                bw.put( 0, 3 );
+                continue;
+            }
+
+            int k[4], max_k = 0, cc = c;
+            for ( int j=0 ; j<4 ; j++ ){
+                int d = ((g[j] - cc) & 0xff);
+                if ( d >= 128 ) d -= 256;
+                k[j] = (d > 0) ? ((d-1) << 1 | 1) : ((-d) << 1);
+                if ( k[j] > max_k ) max_k = k[j];
+                cc += d;
+            }
+            int m = 1;
+            while ( (max_k >> m) > 0 ) m++;
+
+            if ( m >= 8 ){
+                bw.put( 6, 3 );
+                for ( int j=0 ; j<4 ; j++ ) bw.put( g[j], 8 );
+                c = g[3];
+            }
+            else{
+                if ( m <= 2 ){
+                    bw.put( 7, 3 );
+                    bw.put( m-1, 1 );
+                }
+                else{
+                    bw.put( m-2, 3 );
+                }
+                for ( int j=0 ; j<4 ; j++ ) bw.put( k[j], m );
+                c = cc;
+            }
+        }
+    }
+    delete[] data;
+
+    return bw.take( length );
+}
+
+// Greedy LZSS that only refers to window bytes the decoder has set:
+// the zeros it starts with, and what it has output since.
+static unsigned char *encodeLZSS( const unsigned char *src, size_t src_len, size_t *length )
+{
+    BitWriter bw;
+    unsigned char window[N];
+    bool defined[N];
+    for ( int i=0 ; i<N ; i++ ){
+        window[i] = 0;
+        defined[i] = i < N - F;
+    }
+    int r = N - F;
+
+    size_t i = 0;
+    while ( i < src_len ){
+        int best_pos = 0, best_len = 0;
+        for ( int pos=0 ; pos<N && best_len<F ; pos++ ){
+            int l = 0;
+            while ( l < F && i + l < src_len ){
+                int q = (pos + l) & (N - 1);
+                int written = (q - r) & (N - 1); // written by this match
+                int c;
+                if ( written < l )       c = src[i + written];
+                else if ( defined[q] )   c = window[q];
+                else break;
+                if ( c != src[i + l] ) break;
+                l++;
+            }
+            if ( l > best_len ){
+                best_pos = pos;
+                best_len = l;
+            }
+        }
+
+        if ( best_len > P ){
+            bw.put( 0, 1 );
+            bw.put( best_pos, EI );
+            bw.put( best_len - 2, EJ );
+        }
+        else{
+            best_len = 1;
+            bw.put( 1, 1 );
+            bw.put( src[i], 8 );
+        }
+        for ( int k=0 ; k<best_len ; k++ ){
+            window[r] = src[i++];
+            defined[r] = true;
+            r = (r + 1) & (N - 1);
+        }
+    }
+
+    return bw.take( length );
+}
+
+/* ---------------------------------------- */
+
+struct Entry{
+    char name[32];
+    int type;
+    unsigned char *data;
+    size_t length, original_length;
+};
+
+static Entry entries[MAX_ENTRIES];
+static int num_entries = 0;
+static int num_failed = 0;
+
+static void addEntry( const char *name, int type, unsigned char *data, size_t length, size_t original_length )
+{
+    if ( num_entries == MAX_ENTRIES ) return;
+    Entry &e = entries[num_entries++];
+    sprintf( e.name, "%.31s", name );
+    e.type = type;
+    e.data = data;
+    e.length = length;
+    e.original_length = original_length;
+}
+
+static void addSPB( const char *name, int width, int height, unsigned char **plane )
+{
+    size_t length;
+    unsigned char *data = encodeSPB( width, height, plane, &length );
+    addEntry( name, BaseReader::SPB_COMPRESSION, data, length, 0 );
+}
+
+static void addLZSS( const char *name, const unsigned char *src, size_t src_len )
+{
+    size_t length;
+    unsigned char *data = encodeLZSS( src, src_len, &length );
+    addEntry( name, BaseReader::LZSS_COMPRESSION, data, length, src_len );
+
+    // the encoder is checked against the reference decoder
+    unsigned char identity[256];
+    for ( int i=0 ; i<256 ; i++ ) identity[i] = i;
+    unsigned char *buf = new unsigned char[src_len + F];
+    ReferenceDecoder ref( identity, data, length );
+    if ( ref.decodeLZSS( src_len, buf ) != src_len || memcmp( buf, src, src_len ) ){
+        printf( "FAIL encoder %s\n", name );
+        num_failed++;
+    }
+    delete[] buf;
+}
+
+static unsigned char *readFile( const char *file_name, size_t *length )
+{
+    FILE *fp = fopen( file_name, "rb" );
+    if ( fp == NULL ) return NULL;
+    fseek( fp, 0, SEEK_END );
+    *length = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+    unsigned char *buf = new unsigned char[*length];
+    if ( fread( buf, 1, *length, fp ) != *length ){
+        delete[] buf;
+        buf = NULL;
+    }
+    fclose( fp );
+
+    return buf;
+}
+
+static void addBMP( const char *file_name )
+{
+    size_t length;
+    unsigned char *bmp = readFile( file_name, &length );
+    if ( bmp == NULL ){
+        fprintf( stderr, "can't read %s\n", file_name );
+        exit( 1 );
+    }
+
+    const char *base = strrchr( file_name, '/' );
+    base = base ? base+1 : file_name;
+    char name[32];
+    int i;
+    for ( i=0 ; base[i] && base[i] != '.' && i<20 ; i++ )
+        name[i] = (base[i] >= 'a' && base[i] <= 'z') ? base[i] - 'a' + 'A' : base[i];
+
+    strcpy( name+i, ".LZS" );
+    addLZSS( name, bmp, length );
+
+    int width  = bmp[18] | bmp[19] << 8;
+    int height = bmp[22] | bmp[23] << 8;
+    int offset = bmp[10] | bmp[11] << 8;
+    if ( length < 54 || bmp[0] != 'B' || bmp[1] != 'M' || bmp[28] != 24 || bmp[30] != 0 ||
+         offset + (size_t)((width*3+3)&~3) * height > length ){
+        fprintf( stderr, "%s is not a 24-bit BMP, no SPB made\n", file_name );
+        delete[] bmp;
+        return;
+    }
+
+    int stride = (width*3+3) & ~3;
+    unsigned char *plane[3];
+    for ( int c=0 ; c<3 ; c++ ){
+        plane[c] = new unsigned char[width*height];
+        unsigned char *p = plane[c];
+        for ( int y=0 ; y<height ; y++ ){
+            unsigned char *row = bmp + offset + (height-1-y) * stride + c;
+            if ( y & 1 )
+                for ( int x=width-1 ; x>=0 ; x-- ) *p++ = row[x*3];
+            else
+                for ( int x=0 ; x<width ; x++ ) *p++ = row[x*3];
+        }
+    }
+    strcpy( name+i, ".SPB" );
+    addSPB( name, width, height, plane );
+
+    for ( int c=0 ; c<3 ; c++ ) delete[] plane[c];
+    delete[] bmp;
+}
+
+// images that use every SPB code: runs, small and large deltas and
+// raw bytes, at sizes that are not a multiple of the group of four
+static void addSynthetic()
+{
+    static const int size[][2] = { {1,1}, {5,3}, {37,23}, {800,600} };
+    srand( 1 );
+    for ( int s=0 ; s<4 ; s++ ){
+        int width = size[s][0], height = size[s][1];
+        unsigned char *plane[3];
+        for ( int c=0 ; c<3 ; c++ ){
+            plane[c] = new unsigned char[width*height];
+            for ( int i=0 ; i<width*height ; i++ ){
+                int r = rand() % 10;
+                if      ( r < 3 ) plane[c][i] = rand() & 0xff;
+                else if ( r < 6 ) plane[c][i] = (i > 0) ? plane[c][i-1] : 100;
+                else              plane[c][i] = (i / 7 + c * 40 + (rand() % 5)) & 0xff;
+            }
+        }
+        char name[32];
+        sprintf( name, "SYN%dX%d.SPB", width, height );
+        addSPB( name, width, height, plane );
+        for ( int c=0 ; c<3 ; c++ ) delete[] plane[c];
+    }
+
+    unsigned char text[4000];
+    for ( int i=0 ; i<4000 ; i++ ) text[i] = "abcab  \n"[rand() % 8];
+    addLZSS( "SYN.LZS", text, sizeof(text) );
+}
+
+/* ---------------------------------------- */
+
+static void writeLong( FILE *fp, const unsigned char *inverse, unsigned long v )
+{
+    fputc( inverse[(v >> 24) & 0xff], fp );
+    fputc( inverse[(v >> 16) & 0xff], fp );
+    fputc( inverse[(v >>  8) & 0xff], fp );
+    fputc( inverse[ v        & 0xff], fp );
+}
+
+static void writeArchive( const unsigned char *key_table )
+{
+    unsigned char inverse[256];
+    for ( int i=0 ; i<256 ; i++ ) inverse[key_table[i]] = i;
+
+    FILE *fp = fopen( TEST_ARCHIVE, "wb" );
+    if ( fp == NULL ){
+        fprintf( stderr, "can't write %s\n", TEST_ARCHIVE );
+        exit( 1 );
+    }
+
+    size_t base_offset = 6, offset = 0;
+    int i;
+    for ( i=0 ; i<num_entries ; i++ )
+        base_offset += strlen( entries[i].name ) + 1 + 1 + 4 + 4 + 4;
+
+    fputc( inverse[num_entries >> 8], fp );
+    fputc( inverse[num_entries & 0xff], fp );
+    writeLong( fp, inverse, base_offset );
+    for ( i=0 ; i<num_entries ; i++ ){
+        for ( const char *p=entries[i].name ; ; p++ ){
+            fputc( inverse[(unsigned char)*p], fp );
+            if ( *p == 0 ) break;
+        }
+        fputc( inverse[entries[i].type], fp );
+        writeLong( fp, inverse, offset );
+        writeLong( fp, inverse, entries[i].length );
+        writeLong( fp, inverse, entries[i].original_length );
+        offset += entries[i].length;
+    }
+    for ( i=0 ; i<num_entries ; i++ )
+        for ( size_t j=0 ; j<entries[i].length ; j++ )
+            fputc( inverse[entries[i].data[j]], fp );
+
+    fclose( fp );
+}
+
+static double now()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void check( const char *label, const unsigned char *key_table )
+{
+    unsigned char identity[256], inverse[256];
+    for ( int i=0 ; i<256 ; i++ ) identity[i] = i;
+    const unsigned char *table = key_table ? key_table : identity;
+    for ( int i=0 ; i<256 ; i++ ) inverse[table[i]] = i;
+
+    writeArchive( table );
+    DirPaths dir_paths( "." );
+    NsaReader reader( &dir_paths, key_table );
+    if ( reader.openForConvert( TEST_ARCHIVE ) ){
+        fprintf( stderr, "can't open %s\n", TEST_ARCHIVE );
+        exit( 1 );
+    }
+
+    // the reference decoder reads what is in the archive file
+    unsigned char *encoded[MAX_ENTRIES];
+    int i;
+    for ( i=0 ; i<num_entries ; i++ ){
+        encoded[i] = new unsigned char[entries[i].length];
+        for ( size_t j=0 ; j<entries[i].length ; j++ )
+            encoded[i][j] = inverse[entries[i].data[j]];
+    }
+
+    int num_mismatches = 0;
+    double ref_time = 0, new_time = 0;
+    for ( i=0 ; i<num_entries ; i++ ){
+        Entry &e = entries[i];
+        size_t length = reader.getFileLength( e.name );
+        // the old LZSS decoder may overrun by a match length; neither
+        // SPB decoder writes the padding at the end of the rows
+        unsigned char *expected = new unsigned char[length + F];
+        unsigned char *actual = new unsigned char[length + F];
+        memset( expected, 0, length + F );
+        memset( actual, 0, length + F );
+
+        double t = now();
+        size_t expected_len;
+        ReferenceDecoder ref( table, encoded[i], e.length );
+        if ( e.type == BaseReader::SPB_COMPRESSION )
+            expected_len = ref.decodeSPB( expected );
+        else
+            expected_len = ref.decodeLZSS( e.original_length, expected );
+        ref_time += now() - t;
+
+        t = now();
+        size_t actual_len = reader.getFile( e.name, actual );
+        new_time += now() - t;
+
+        bool ok = ( actual_len == expected_len && expected_len == length &&
+                    memcmp( actual, expected, length ) == 0 );
+        if ( !ok ){
+            printf( "FAIL %s %s: %lu bytes, expected %lu\n", label, e.name,
+                    (unsigned long)actual_len, (unsigned long)expected_len );
+            num_mismatches++;
+        }
+
+        delete[] expected;
+        delete[] actual;
+        delete[] encoded[i];
+    }
+    printf( "%s: %d/%d entries match, reference %.3f s, NsaReader %.3f s\n",
+            label, num_entries - num_mismatches, num_entries, ref_time, new_time );
+    num_failed += num_mismatches;
+}
+
+int main( int argc, char **argv )
+{
+    for ( int i=1 ; i<argc ; i++ ) addBMP( argv[i] );
+    addSynthetic();
+
+    unsigned char key_table[256];
+    for ( int i=0 ; i<256 ; i++ ) key_table[i] = (i * 167 + 13) & 0xff;
+
+    check( "plain", NULL );
+    check( "key table", key_table );
+    remove( TEST_ARCHIVE );
+
+    for ( int i=0 ; i<num_entries ; i++ ) delete[] entries[i].data;
+
+    if ( num_failed ){
+        printf( "%d failures\n", num_failed );
+        return 1;
+    }
+    printf( "all decoders match\n" );
+
+    return 0;
+}